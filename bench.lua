@@ -0,0 +1,33 @@
+local sss = require'sss'
+
+-- Throughput of create and combine with every GF(2^8) engine the CPU supports
+if not sss.engine then
+  print('sss was built without the GF(2^8) engines')
+  return
+end
+
+local size = tonumber(arg and arg[1]) or 1024 * 1024
+local n, k = 5, 3
+local rounds = math.max(1, math.floor(16 * 1024 * 1024 / size))
+local msg = sss.random(size)
+local default = sss.engine()
+
+local function run(f)
+  local t0 = os.clock()
+  for _ = 1, rounds do f() end
+  return (os.clock() - t0) / rounds
+end
+
+print(string.format('secret %d bytes, %d of %d shares', size, k, n))
+for _, name in ipairs({'scalar', 'bitslice', 'ssse3', 'avx2'}) do
+  if pcall(sss.engine, name) then
+    local t
+    local create = run(function() t = sss.create(msg, n, k) end)
+    local combine = run(function() sss.combine({t[1], t[2], t[3]}) end)
+    print(string.format('%-9s create %8.2f ns/byte %9.1f MB/s   ' ..
+                        'combine %8.2f ns/byte %9.1f MB/s',
+                        name, create * 1e9 / size, size / create / 1e6,
+                        combine * 1e9 / size, size / combine / 1e6))
+  end
+end
+sss.engine(default)
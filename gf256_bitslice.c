@@ -0,0 +1,144 @@
+/*
+ * Bitsliced GF(2 ^ 8) dot product kernel.
+ *
+ * 64 bytes are transposed into eight 64-bit words, word b holding bit b of
+ * every byte. Multiplying by x is then a fixed permutation of the words with
+ * the reduction by IRREDUCTIBLE_POLY folded in, and multiplying by a constant
+ * adds up the multiples by x^i selected with AND masks of its bits. No memory
+ * is indexed by data and no branch depends on it, so the running time does
+ * not leak the secret bytes. Only plain uint64_t operations are used.
+ *
+ * This file is included by sss.c after the scalar field arithmetic and must
+ * not be compiled on its own.
+ */
+
+#define BITSLICE_BYTES 64
+
+// Transpose the 8 x 8 bit matrix held in a word, rows being bytes
+inline static uint64_t bitslice_transpose8(uint64_t x) {
+  uint64_t t;
+
+  t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+  x = x ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+  x = x ^ t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+  x = x ^ t ^ (t << 28);
+  return x;
+}
+
+// Swap the bytes of a and b selected by the mask, b shifted by the distance
+#define BITSLICE_SWAP(a, b, shift, mask)                                       \
+  do {                                                                         \
+    uint64_t t = (((a) >> (shift)) ^ (b)) & (mask);                            \
+    (b) ^= t;                                                                  \
+    (a) ^= t << (shift);                                                       \
+  } while (0)
+
+// Transpose the 8 x 8 byte matrix held in 8 words, rows being words
+inline static void bitslice_transpose_bytes(uint64_t *w) {
+  const uint64_t m8 = 0x00ff00ff00ff00ffULL;
+  const uint64_t m16 = 0x0000ffff0000ffffULL;
+  const uint64_t m32 = 0x00000000ffffffffULL;
+
+  BITSLICE_SWAP(w[0], w[1], 8, m8);
+  BITSLICE_SWAP(w[2], w[3], 8, m8);
+  BITSLICE_SWAP(w[4], w[5], 8, m8);
+  BITSLICE_SWAP(w[6], w[7], 8, m8);
+  BITSLICE_SWAP(w[0], w[2], 16, m16);
+  BITSLICE_SWAP(w[1], w[3], 16, m16);
+  BITSLICE_SWAP(w[4], w[6], 16, m16);
+  BITSLICE_SWAP(w[5], w[7], 16, m16);
+  BITSLICE_SWAP(w[0], w[4], 32, m32);
+  BITSLICE_SWAP(w[1], w[5], 32, m32);
+  BITSLICE_SWAP(w[2], w[6], 32, m32);
+  BITSLICE_SWAP(w[3], w[7], 32, m32);
+}
+
+// Spread 64 bytes into 8 bit planes
+inline static void bitslice_load(const uint8_t *src, uint64_t *planes) {
+  memcpy(planes, src, BITSLICE_BYTES);
+  for (int j = 0; j < 8; j++)
+    planes[j] = bitslice_transpose8(planes[j]);
+  bitslice_transpose_bytes(planes);
+}
+
+// Gather 8 bit planes back into 64 bytes and add them into dst
+inline static void bitslice_store_add(uint64_t *planes, uint8_t *dst) {
+  uint64_t w[8];
+
+  memcpy(w, dst, BITSLICE_BYTES);
+  bitslice_transpose_bytes(planes);
+  for (int j = 0; j < 8; j++)
+    w[j] ^= bitslice_transpose8(planes[j]);
+  memcpy(dst, w, BITSLICE_BYTES);
+}
+
+// Multiply 64 bitsliced bytes by a constant and add them into acc.
+// The bits of the constant only select terms with AND masks.
+inline static void bitslice_mul_add(uint8_t c, const uint64_t *s,
+                                    uint64_t *acc) {
+  uint64_t s0 = s[0], s1 = s[1], s2 = s[2], s3 = s[3];
+  uint64_t s4 = s[4], s5 = s[5], s6 = s[6], s7 = s[7];
+  uint64_t a0 = acc[0], a1 = acc[1], a2 = acc[2], a3 = acc[3];
+  uint64_t a4 = acc[4], a5 = acc[5], a6 = acc[6], a7 = acc[7];
+
+  for (int i = 0; i < 8; i++) {
+    uint64_t mask = (uint64_t)0 - ((c >> i) & 1);
+    a0 ^= s0 & mask;
+    a1 ^= s1 & mask;
+    a2 ^= s2 & mask;
+    a3 ^= s3 & mask;
+    a4 ^= s4 & mask;
+    a5 ^= s5 & mask;
+    a6 ^= s6 & mask;
+    a7 ^= s7 & mask;
+
+    // s = s.x, x^8 being reduced to x^4 + x^3 + x + 1
+    uint64_t top = s7;
+    s7 = s6;
+    s6 = s5;
+    s5 = s4;
+    s4 = s3 ^ top;
+    s3 = s2 ^ top;
+    s2 = s1;
+    s1 = s0 ^ top;
+    s0 = top;
+  }
+
+  acc[0] = a0, acc[1] = a1, acc[2] = a2, acc[3] = a3;
+  acc[4] = a4, acc[5] = a5, acc[6] = a6, acc[7] = a7;
+}
+
+// Add the dot product of the constants and the source vectors into dst.
+// The accumulator stays bitsliced across all the terms, so each block of
+// dst is transposed back once.
+static void p_dot_bitslice(const uint8_t *cs, const uint8_t *const *srcs,
+                           int cnt, uint8_t *dst, size_t len) {
+  uint64_t s[8], acc[8];
+  size_t i = 0;
+
+  for (; i + BITSLICE_BYTES <= len; i += BITSLICE_BYTES) {
+    memset(acc, 0, sizeof(acc));
+    for (int j = 0; j < cnt; j++) {
+      bitslice_load(srcs[j] + i, s);
+      bitslice_mul_add(cs[j], s, acc);
+    }
+    bitslice_store_add(acc, dst + i);
+  }
+
+  // Zero pad the tail to a whole block
+  if (i < len) {
+    uint8_t block[BITSLICE_BYTES] = {0};
+
+    memset(acc, 0, sizeof(acc));
+    for (int j = 0; j < cnt; j++) {
+      memcpy(block, srcs[j] + i, len - i);
+      bitslice_load(block, s);
+      bitslice_mul_add(cs[j], s, acc);
+    }
+    memcpy(block, dst + i, len - i);
+    bitslice_store_add(acc, block);
+    memcpy(dst + i, block, len - i);
+  }
+}
@@ -0,0 +1,77 @@
+/*
+ * Vectorized GF(2 ^ 8) multiply-accumulate kernels.
+ *
+ * A product c.s is split into c.(s & 0x0f) ^ c.(s & 0xf0). Both halves only
+ * take 16 values, so they are looked up with a byte shuffle from two 16 byte
+ * tables built for the constant c. This file is included by sss.c after the
+ * scalar field arithmetic and must not be compiled on its own.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+
+#include <immintrin.h>
+
+#define HAVE_GF256_SIMD
+
+// Products of the constant with every low nibble and every high nibble
+inline static void p_mul_nibble_tables(uint8_t c, uint8_t *lo, uint8_t *hi) {
+  for (int i = 0; i < 16; i++) {
+    lo[i] = p_mul(c, i);
+    hi[i] = p_mul(c, i << 4);
+  }
+}
+
+__attribute__((target("ssse3"))) static void
+p_mul_add_ssse3(uint8_t c, const uint8_t *src, uint8_t *dst, size_t len) {
+  uint8_t lo[16], hi[16];
+  size_t i = 0;
+
+  if (c == 0)
+    return;
+  p_mul_nibble_tables(c, lo, hi);
+
+  __m128i t_lo = _mm_loadu_si128((const __m128i *)lo);
+  __m128i t_hi = _mm_loadu_si128((const __m128i *)hi);
+  __m128i mask = _mm_set1_epi8(0x0f);
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+    __m128i l = _mm_shuffle_epi8(t_lo, _mm_and_si128(s, mask));
+    __m128i h =
+        _mm_shuffle_epi8(t_hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+    d = _mm_xor_si128(d, _mm_xor_si128(l, h));
+    _mm_storeu_si128((__m128i *)(dst + i), d);
+  }
+  p_mul_add(c, src + i, dst + i, len - i);
+}
+
+__attribute__((target("avx2"))) static void
+p_mul_add_avx2(uint8_t c, const uint8_t *src, uint8_t *dst, size_t len) {
+  uint8_t lo[16], hi[16];
+  size_t i = 0;
+
+  if (c == 0)
+    return;
+  p_mul_nibble_tables(c, lo, hi);
+
+  __m256i t_lo =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lo));
+  __m256i t_hi =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hi));
+  __m256i mask = _mm256_set1_epi8(0x0f);
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+    __m256i l = _mm256_shuffle_epi8(t_lo, _mm256_and_si256(s, mask));
+    __m256i h = _mm256_shuffle_epi8(
+        t_hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask));
+    d = _mm256_xor_si256(d, _mm256_xor_si256(l, h));
+    _mm256_storeu_si256((__m256i *)(dst + i), d);
+  }
+  p_mul_add(c, src + i, dst + i, len - i);
+}
+
+#endif
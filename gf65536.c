@@ -0,0 +1,125 @@
+/*
+ * GF(2 ^ 16) arithmetic.
+ *
+ * Symbols are 16-bit words stored big-endian, so the field has 65535 non-zero
+ * x coordinates where GF(2 ^ 8) has 255. Products go through logarithm and
+ * exponent tables of the generator 0x0002 like those of the byte field, but
+ * at 384 KB they are built once when the module is first opened instead of
+ * being written out. The lookups are indexed by the secret symbols, as with
+ * the scalar GF(2 ^ 8) kernel.
+ *
+ * This file is included by sss.c and must not be compiled on its own.
+ */
+
+#if defined(PTHREADS)
+#include <pthread.h>
+#endif
+
+// x^16 + x^12 + x^3 + x + 1, primitive so that 0x0002 generates the field
+#define GF65536_POLY 0x1100b
+
+// Number of non-zero elements, the order of the generator
+#define GF65536_ORDER 65535
+
+// log_2(a) for a = 1..65535; log of 0 is undefined and left as 0
+static uint16_t GF65536_LOG[65536];
+
+// 2 ^ i for i = 0..131069, doubled so that log(a) + log(b) needs no reduction
+static uint16_t GF65536_EXP[2 * GF65536_ORDER];
+
+static void gf65536_tables_init(void) {
+  uint32_t a = 1;
+
+  for (int i = 0; i < GF65536_ORDER; i++) {
+    GF65536_EXP[i] = GF65536_EXP[i + GF65536_ORDER] = (uint16_t)a;
+    GF65536_LOG[a] = (uint16_t)i;
+    a <<= 1;
+    if (a & 0x10000)
+      a ^= GF65536_POLY;
+  }
+}
+
+#if defined(PTHREADS)
+static pthread_once_t gf65536_once = PTHREAD_ONCE_INIT;
+#else
+static int gf65536_ready = 0;
+#endif
+
+// Build the tables, once for all the Lua states
+static void gf65536_init(void) {
+#if defined(PTHREADS)
+  pthread_once(&gf65536_once, gf65536_tables_init);
+#else
+  if (!gf65536_ready) {
+    gf65536_tables_init();
+    gf65536_ready = 1;
+  }
+#endif
+}
+
+// The symbol at p
+inline static uint16_t gf65536_load(const uint8_t *p) {
+  return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+// Store the symbol s at p
+inline static void gf65536_store(uint8_t *p, uint16_t s) {
+  p[0] = (uint8_t)(s >> 8);
+  p[1] = (uint8_t)s;
+}
+
+// Multiply the symbols of src by c and add them into dst, len bytes
+inline static void gf65536_mul_add(uint16_t c, const uint8_t *src,
+                                   uint8_t *dst, size_t len) {
+  if (c == 0)
+    return;
+  uint32_t log_c = GF65536_LOG[c];
+  for (size_t i = 0; i < len; i += 2) {
+    uint16_t s = gf65536_load(src + i);
+    if (s != 0) {
+      uint16_t p = GF65536_EXP[log_c + GF65536_LOG[s]];
+      dst[i] ^= (uint8_t)(p >> 8);
+      dst[i + 1] ^= (uint8_t)p;
+    }
+  }
+}
+
+// One step of Horner's rule on len bytes of symbols: y = x * y + a, x not
+// zero
+inline static void gf65536_horner(uint16_t x, const uint8_t *a, uint8_t *y,
+                                  size_t len) {
+  uint32_t log_x = GF65536_LOG[x];
+
+  for (size_t i = 0; i < len; i += 2) {
+    uint16_t s = gf65536_load(y + i);
+    uint16_t p = s == 0 ? 0 : GF65536_EXP[log_x + GF65536_LOG[s]];
+    gf65536_store(y + i, p ^ gf65536_load(a + i));
+  }
+}
+
+// Compute the Lagrange basis polynomials of the k x points evaluated at
+// x = 0, adding up logarithms instead of multiplying and dividing.
+// Returns 0 when an x point is zero or two are equal.
+static int gf65536_lagrange(const uint16_t *xs, int k, uint16_t *coeffs) {
+  uint64_t log_xs = 0;
+
+  for (int m = 0; m < k; m++) {
+    if (xs[m] == 0)
+      return 0;
+    log_xs += GF65536_LOG[xs[m]];
+  }
+  for (int j = 0; j < k; j++) {
+    // prod x[m] / (x[m] - x[j]) for m != j
+    uint64_t num = log_xs - GF65536_LOG[xs[j]], den = 0;
+    for (int m = 0; m < k; m++) {
+      if (m != j) {
+        if (xs[m] == xs[j])
+          return 0;
+        den += GF65536_LOG[xs[m] ^ xs[j]];
+      }
+    }
+    coeffs[j] = GF65536_EXP[num % GF65536_ORDER + GF65536_ORDER -
+                            den % GF65536_ORDER];
+  }
+  return 1;
+}
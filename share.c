@@ -30,28 +30,85 @@
 /** The implementation methods for share operations. */
 static SHARE_METH share_meths[] =
 {
+#if defined(SHARE_NATIVE)
+    /* The implementations with fixed size numbers for the built-in primes. */
+    { "Native 128",
+      128, 0,
+      share_native_num_new, share_native_num_free,
+      share_native_num_from_bin, share_native_num_to_bin,
+      share_native_ctx_new, share_native_ctx_free,
+      share_native_split, share_native_join,
+      share_native_weights, share_native_combine,
+      share_native_weights_small, share_native_split_batch },
+    { "Native 192",
+      192, 0,
+      share_native_num_new, share_native_num_free,
+      share_native_num_from_bin, share_native_num_to_bin,
+      share_native_ctx_new, share_native_ctx_free,
+      share_native_split, share_native_join,
+      share_native_weights, share_native_combine,
+      share_native_weights_small, share_native_split_batch },
+    { "Native 256",
+      256, 0,
+      share_native_num_new, share_native_num_free,
+      share_native_num_from_bin, share_native_num_to_bin,
+      share_native_ctx_new, share_native_ctx_free,
+      share_native_split, share_native_join,
+      share_native_weights, share_native_combine,
+      share_native_weights_small, share_native_split_batch },
+#endif
+    /* The implementation that uses OpenSSL with Montgomery multiplication. */
+    { "OpenSSL Montgomery",
+      0, 0,
+      share_openssl_num_new, share_openssl_num_free,
+      share_openssl_mont_num_from_bin, share_openssl_mont_num_to_bin,
+      share_openssl_mont_ctx_new, share_openssl_ctx_free,
+      share_openssl_mont_split, share_openssl_mont_join,
+      share_openssl_mont_weights, share_openssl_mont_combine, NULL, NULL },
     /* The generic implementation that uses OpenSSL. */
     { "OpenSSL Generic",
       0, 0,
       share_openssl_num_new, share_openssl_num_free,
       share_openssl_num_from_bin, share_openssl_num_to_bin,
-      share_openssl_split, share_openssl_join },
+      share_openssl_ctx_new, share_openssl_ctx_free,
+      share_openssl_split, share_openssl_join,
+      share_openssl_weights, share_openssl_combine, NULL, NULL },
 };
 
 /** The number of implementation methods. */
 #define SHARE_METHS_NUM ((int8_t)(sizeof(share_meths)/(sizeof(*share_meths))))
 
+/**
+ * Check whether the name of an implementation method is the name requested:
+ * the whole name or the words before its size, as in "Native" for
+ * "Native 256".
+ *
+ * @param [in] meth  The implementation method.
+ * @param [in] name  The name requested.
+ * @return  1 when the names match.<br>
+ *          0 otherwise.
+ */
+static int share_meth_named(SHARE_METH *meth, const char *name)
+{
+    size_t len = strlen(name);
+
+    return (strncmp(meth->name, name, len) == 0) &&
+        ((meth->name[len] == '\0') || (meth->name[len] == ' '));
+}
+
 /**
  * Retrieves an implementation method that matches the requirements.
  *
  * @param [in]  len    The length of the secret in bits required to be
  *                     supported.
  * @param [in]  parts  The number of parts required to be supported.
+ * @param [in]  name   The name of the implementation method. Any: NULL.
  * @param [out] meth   The method that matches the requirements.
  * @return  NOT_FOUND when no available method meets the requirements.<br>
  *          NONE otherwise.
  */
-SHARE_ERR share_meths_get(uint16_t len, uint8_t parts, SHARE_METH **meth)
+SHARE_ERR share_meths_get(uint16_t len, uint8_t parts, const char *name,
+    SHARE_METH **meth)
 {
     SHARE_ERR err = NOT_FOUND;
     int8_t i;
@@ -62,10 +119,11 @@ SHARE_ERR share_meths_get(uint16_t len, uint8_t parts, SHARE_METH **meth)
     {
         /* Length of zero indicates no restriction. Otherwise it must match.
          * Parts of zero indicates no restriction. Otherwise it must match.
-         * Must have at least the flags requested.
+         * The name must match when one is requested.
          */
         if (((share_meths[i].len == 0) || (share_meths[i].len == len)) &&
-            ((share_meths[i].parts == 0) || (share_meths[i].parts == parts)))
+            ((share_meths[i].parts == 0) || (share_meths[i].parts == parts)) &&
+            ((name == NULL) || share_meth_named(&share_meths[i], name)))
         {
             m = &share_meths[i];
             err = NONE;
@@ -78,6 +136,16 @@ SHARE_ERR share_meths_get(uint16_t len, uint8_t parts, SHARE_METH **meth)
     return err;
 }
 
+/** The version byte at the start of a split in the compact format. */
+#define SHARE_COMPACT_VERSION	0x01
+
+/** The length of the version byte and the x ordinate of the compact format.
+ */
+#define SHARE_COMPACT_X_LEN	3
+
+/** The number of splits calculated together by SHARE_split_at_n(). */
+#define SHARE_SPLIT_BATCH	8
+
 /*** private structure */
 /** The structure holding primes to use. */
 typedef struct share_prime_st
@@ -97,24 +165,44 @@ struct share_st
     SHARE_METH *meth;
     /** The length of the secret in bytes. */
     uint16_t len;
+    /** The number of blocks the secret is split in. The blocks of a split
+     * share its x ordinate. */
+    uint16_t blocks;
     /** The mask for the top word. */
     uint8_t mask;
     /** The number of parts required to calculate the secret. */
     uint8_t parts;
+    /** The format of the encoded splits. */
+    uint8_t format;
     /** The length of the prime in bytes. */
     uint16_t prime_len;
     /** The prime as a number object. */
     void *prime;
-    /** An array of number objects. */
+    /** An array of number objects. The coefficients of the blocks one after
+     * the other when splitting, the x ordinates when joining. */
     void **num;
-    /** An array of number objects. */
+    /** An array of number objects. The y ordinates of the blocks one after
+     * the other when joining. */
     void **y;
+    /** An array of number objects holding the weights of the splits. */
+    void **w;
+    /** The x ordinates of the splits added when joining, 0 when not a
+     * 16-bit integer. */
+    uint16_t *xs;
+    /** An array of number objects. The y ordinates of a batch of splits. */
+    void **ys;
     /** Storage for encoded and decoded numbers. */
     uint8_t *random;
     /** Result number object. */
     void *res;
+    /** The context of the implementation method. */
+    void *ctx;
     /** Count of splits generated when splitting or added when joining. */
     int cnt;
+    /** Random number generator, SHARE_random when NULL. */
+    SHARE_RANDOM_FUNC rng;
+    /** Context passed to the random number generator. */
+    void *rng_ctx;
 };
 
 /** The prime that supports up to 128-bit secrets. */
@@ -190,9 +278,54 @@ SHARE_ERR share_prime_get(uint16_t len, const uint8_t **data, uint16_t *dlen,
     return err;
 }
 
+/**
+ * Retrieve the prime and the number of blocks that support the secret length
+ * specified. Secrets longer than the largest prime supports are split in
+ * blocks of its bits, the first block holding what the others leave over.
+ *
+ * @param [in]  len     The length of the secret in bits.
+ * @param [out] data    The encoded prime.
+ * @param [out] dlen    The length of the encoded prime in bytes.
+ * @param [out] bits    The length of the encoded prime in bits.
+ * @param [out] blocks  The number of blocks of the secret.
+ * @return  NOT_FOUND when no prime supports the blocks.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_blocks_get(uint16_t len, const uint8_t **data, uint16_t *dlen,
+    uint16_t *bits, uint16_t *blocks)
+{
+    uint16_t max = share_primes[SHARE_PRIME_NUM-1].max;
+
+    *blocks = 1;
+    if (len > max)
+    {
+        *blocks = (len + max - 1) / max;
+        len = max;
+    }
+    return share_prime_get(len, data, dlen, bits);
+}
+
+/**
+ * Get the length of the part of the secret in a block.
+ *
+ * @param [in] share  The share operation object.
+ * @param [in] b      The index of the block.
+ * @return  The length of the part of the secret in bytes.
+ */
+static uint16_t share_block_len(SHARE *share, uint16_t b)
+{
+    if (b > 0)
+        return share->prime_len - 1;
+    return share->len - (share->blocks - 1) * (share->prime_len - 1);
+}
+
 
 /**
  * Create a new object that is used to split and join secrets.
+ * Secrets longer than the largest prime are split in blocks that share the x
+ * ordinate of each split, the encoded split being the x ordinate followed by
+ * the y ordinate of each block. See SHARE_set_format() for the encoding of the
+ * x ordinate.
  *
  * @param [in]  len    The length of the secret in bytes.
  * @param [in]  parts  The number of parts required to recreate secret.
@@ -205,15 +338,40 @@ SHARE_ERR share_prime_get(uint16_t len, const uint8_t **data, uint16_t *dlen,
  *          NONE otherwise.
  */
 SHARE_ERR SHARE_new(uint16_t len, uint8_t parts, SHARE **share)
+{
+    return SHARE_new_impl(len, parts, NULL, share);
+}
+
+/**
+ * Create a new object that is used to split and join secrets with the
+ * implementation method of the name. All the implementations give the same
+ * splits, so this is for testing and comparing them.
+ *
+ * @param [in]  len    The length of the secret in bytes.
+ * @param [in]  parts  The number of parts required to recreate secret.
+ * @param [in]  name   The name of the implementation method, or the words
+ *                     before its size. The first that supports the secret:
+ *                     NULL.
+ * @param [out] share  The new share operation object.
+ * @return  PARAM_NULL when share is NULL.
+ *          PARAM_BAD_VALUE when parts and/or length are invalid.<br>
+ *          NOT_FOUND when no prime or implementation supports the requirements.
+ *          <br>
+ *          ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR SHARE_new_impl(uint16_t len, uint8_t parts, const char *name,
+    SHARE **share)
 {
     SHARE_ERR err = NONE;
     SHARE *s = NULL;
     SHARE_METH *meth;
     uint16_t prime_bits;
     uint16_t prime_len;
+    uint16_t blocks;
     const uint8_t *prime_data;
     void *prime = NULL;
-    int i;
+    int i, nums;
 
     if (share == NULL)
     {
@@ -231,17 +389,17 @@ SHARE_ERR SHARE_new(uint16_t len, uint8_t parts, SHARE **share)
         goto end;
     }
 
-    /* Retrieve the matching prime. */
-    err = share_prime_get(len, &prime_data, &prime_len, &prime_bits);
+    /* Retrieve the matching prime and the number of blocks. */
+    err = share_blocks_get(len, &prime_data, &prime_len, &prime_bits, &blocks);
     if (err != NONE) goto end;
 
     /* Retrieve an implementation. */
-    err = share_meths_get(prime_bits, parts,  &meth);
+    err = share_meths_get(prime_bits, parts, name, &meth);
     if (err != NONE) goto end;
 
     err = meth->num_new(prime_len, &prime);
     if (err != NONE) goto end;
-    err = meth->num_from_bin(prime_data, prime_len, prime);
+    err = meth->num_from_bin(NULL, prime_data, prime_len, prime);
     if (err != NONE) goto end;
 
     /* Allocate dynamic memory and initialize for object. */
@@ -256,25 +414,35 @@ SHARE_ERR SHARE_new(uint16_t len, uint8_t parts, SHARE **share)
     /* Initialize object. */
     s->meth = meth;
     s->len = (len + 7) / 8;
+    s->blocks = blocks;
     s->mask = ((len & 7) == 0) ? 0xff : (1 << (len & 7)) - 1;
     s->parts = parts;
     s->prime_len = prime_len;
     s->prime = prime;
     prime = NULL;
-    s->num = malloc(parts * sizeof(*s->num));
-    s->y = malloc(parts * sizeof(*s->y));
+    /* Coefficients and y ordinates for each block. */
+    nums = parts * blocks;
+    s->num = malloc(nums * sizeof(*s->num));
+    s->y = malloc(nums * sizeof(*s->y));
+    s->w = malloc(parts * sizeof(*s->w));
+    s->xs = malloc(parts * sizeof(*s->xs));
+    s->ys = malloc(SHARE_SPLIT_BATCH * sizeof(*s->ys));
     s->random = malloc(prime_len);
-    if ((s->num == NULL) || (s->y == NULL) || (s->random == NULL))
+    if ((s->num == NULL) || (s->y == NULL) || (s->w == NULL) ||
+        (s->xs == NULL) || (s->ys == NULL) || (s->random == NULL))
     {
         err = ALLOC;
         goto end;
     }
-    memset(s->num, 0, parts * sizeof(*s->num));
-    memset(s->y, 0, parts * sizeof(*s->num));
-    memset(s->random, 0, prime_len - s->len);
+    memset(s->num, 0, nums * sizeof(*s->num));
+    memset(s->y, 0, nums * sizeof(*s->num));
+    memset(s->w, 0, parts * sizeof(*s->w));
+    memset(s->xs, 0, parts * sizeof(*s->xs));
+    memset(s->ys, 0, SHARE_SPLIT_BATCH * sizeof(*s->ys));
+    memset(s->random, 0, prime_len);
 
     /* Create numbers to support split and join operations. */
-    for (i=0; i<s->parts; i++)
+    for (i=0; i<nums; i++)
     {
         if (s->num[i] == NULL)
         {
@@ -282,7 +450,7 @@ SHARE_ERR SHARE_new(uint16_t len, uint8_t parts, SHARE **share)
             if (err != NONE) goto end;
         }
     }
-    for (i=0; i<s->parts; i++)
+    for (i=0; i<nums; i++)
     {
         if (s->y[i] == NULL)
         {
@@ -290,9 +458,25 @@ SHARE_ERR SHARE_new(uint16_t len, uint8_t parts, SHARE **share)
             if (err != NONE) goto end;
         }
     }
+    for (i=0; i<s->parts; i++)
+    {
+        err = s->meth->num_new(s->prime_len, &s->w[i]);
+        if (err != NONE) goto end;
+    }
+    for (i=0; i<SHARE_SPLIT_BATCH; i++)
+    {
+        err = s->meth->num_new(s->prime_len, &s->ys[i]);
+        if (err != NONE) goto end;
+    }
     /* Create a number to hold the result of the calculation. */
     err = s->meth->num_new(s->prime_len, &s->res);
     if (err != NONE) goto end;
+    /* Create the temporaries of the calculations once. */
+    if (s->meth->ctx_new != NULL)
+    {
+        err = s->meth->ctx_new(s->prime, s->parts, &s->ctx);
+        if (err != NONE) goto end;
+    }
 
     *share = s;
     s = NULL;
@@ -313,17 +497,31 @@ void SHARE_free(SHARE *share)
 
     if (share != NULL)
     {
+        if (share->ctx != NULL) share->meth->ctx_free(share->ctx);
         share->meth->num_free(share->res);
         if (share->random != NULL) free(share->random);
-        if (share->y != NULL)
+        if (share->xs != NULL) free(share->xs);
+        if (share->ys != NULL)
+        {
+            for (i=0; i<SHARE_SPLIT_BATCH; i++)
+                share->meth->num_free(share->ys[i]);
+            free(share->ys);
+        }
+        if (share->w != NULL)
         {
             for (i=0; i<share->parts; i++)
+                share->meth->num_free(share->w[i]);
+            free(share->w);
+        }
+        if (share->y != NULL)
+        {
+            for (i=0; i<share->parts*share->blocks; i++)
                 share->meth->num_free(share->y[i]);
             free(share->y);
         }
         if (share->num != NULL)
         {
-            for (i=0; i<share->parts; i++)
+            for (i=0; i<share->parts*share->blocks; i++)
                 share->meth->num_free(share->num[i]);
             free(share->num);
         }
@@ -332,6 +530,55 @@ void SHARE_free(SHARE *share)
     }
 }
 
+/**
+ * Clear the secret, the coefficients and the splits held by the object, so
+ * that it can be kept for later splits and joins.
+ *
+ * @param [in] share  The share operation object.
+ * @return  PARAM_NULL when share is NULL.<br>
+ *          ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR SHARE_clear(SHARE *share)
+{
+    SHARE_ERR err = NONE;
+    int i;
+
+    if (share == NULL)
+    {
+        err = PARAM_NULL;
+        goto end;
+    }
+
+    /* Decoding zero overwrites the whole number. */
+    memset(share->random, 0, share->prime_len);
+    for (i=0; (err == NONE) && (i<share->parts*share->blocks); i++)
+    {
+        err = share->meth->num_from_bin(NULL, share->random,
+            share->prime_len, share->num[i]);
+        if (err == NONE)
+            err = share->meth->num_from_bin(NULL, share->random,
+                share->prime_len, share->y[i]);
+    }
+    for (i=0; (err == NONE) && (i<share->parts); i++)
+    {
+        err = share->meth->num_from_bin(NULL, share->random,
+            share->prime_len, share->w[i]);
+    }
+    for (i=0; (err == NONE) && (i<SHARE_SPLIT_BATCH); i++)
+    {
+        err = share->meth->num_from_bin(NULL, share->random,
+            share->prime_len, share->ys[i]);
+    }
+    if (err == NONE)
+        err = share->meth->num_from_bin(NULL, share->random,
+            share->prime_len, share->res);
+    memset(share->xs, 0, share->parts * sizeof(*share->xs));
+    share->cnt = 0;
+end:
+    return err;
+}
+
 /**
  * Get the length of the encoded share.
  *
@@ -350,7 +597,11 @@ SHARE_ERR SHARE_get_len(SHARE *share, uint16_t *len)
         goto end;
     }
 
-    *len = share->prime_len * 2;
+    /* The x ordinate and the y ordinate of each block. */
+    if (share->format == SHARE_FORMAT_COMPACT)
+        *len = SHARE_COMPACT_X_LEN + share->prime_len * share->blocks;
+    else
+        *len = share->prime_len * (1 + share->blocks);
 end:
     return err;
 }
@@ -401,6 +652,79 @@ end:
     return err;
 }
 
+/**
+ * Set the random number generator used when splitting.
+ *
+ * @param [in] share  The share operation object.
+ * @param [in] func   The random number generator. NULL for SHARE_random.
+ * @param [in] ctx    The context passed to the random number generator.
+ * @return  PARAM_NULL when share is NULL.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR SHARE_set_random(SHARE *share, SHARE_RANDOM_FUNC func, void *ctx)
+{
+    SHARE_ERR err = NONE;
+
+    if (share == NULL)
+    {
+        err = PARAM_NULL;
+        goto end;
+    }
+
+    share->rng = func;
+    share->rng_ctx = ctx;
+end:
+    return err;
+}
+
+/**
+ * Set the format of the encoded splits.
+ * The compact format encodes the x ordinate in two bytes after a version byte
+ * instead of in a number as long as the prime, so its splits are generated
+ * with SHARE_split_at_n() at chosen x ordinates, not with SHARE_split().
+ *
+ * @param [in] share   The share operation object.
+ * @param [in] format  The format of the encoded splits.
+ * @return  PARAM_NULL when share is NULL.<br>
+ *          PARAM_BAD_VALUE when the format is not supported.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR SHARE_set_format(SHARE *share, SHARE_FORMAT format)
+{
+    SHARE_ERR err = NONE;
+
+    if (share == NULL)
+    {
+        err = PARAM_NULL;
+        goto end;
+    }
+    if ((format != SHARE_FORMAT_FULL) && (format != SHARE_FORMAT_COMPACT))
+    {
+        err = PARAM_BAD_VALUE;
+        goto end;
+    }
+
+    share->format = (uint8_t)format;
+end:
+    return err;
+}
+
+/**
+ * Fill the buffer with random bytes from the generator of the object.
+ *
+ * @param [in] share  The share operation object.
+ * @param [in] r      The buffer to fill.
+ * @param [in] len    The length of the buffer in bytes.
+ * @return  0 on success.<br>
+ *          Non-zero when random data is not available.
+ */
+static int share_random(SHARE *share, unsigned char *r, int len)
+{
+    if (share->rng != NULL)
+        return share->rng(share->rng_ctx, r, len);
+    return SHARE_random(r, len);
+}
+
 /**
  * Initialize the generation of splits from the secret.
  *
@@ -415,7 +739,9 @@ SHARE_ERR SHARE_split_init(SHARE *share, uint8_t *secret)
 {
     SHARE_ERR err = NONE;
     int i;
-    uint8_t *r, *t = NULL;
+    uint16_t b, len;
+    uint8_t *r;
+    void **num;
 
     if ((share == NULL) || (secret == NULL))
     {
@@ -423,51 +749,97 @@ SHARE_ERR SHARE_split_init(SHARE *share, uint8_t *secret)
         goto end;
     }
 
-    /* Generate all the random coefficient data at once - quicker. */
-    t = malloc(share->len * (share->parts-1));
-    if (t == NULL)
-    {
-        err = ALLOC;
-        goto end;
-    }
-    if (SHARE_random(t, share->len * (share->parts-1)) != 0)
+    /* Each block of the secret has its own coefficients. */
+    for (b=0; b<share->blocks; b++)
     {
-        err = RANDOM;
-        goto end;
+        num = &share->num[b*share->parts];
+        len = share_block_len(share, b);
+
+        /* The first coefficient is the block of the secret. */
+        r = &share->random[share->prime_len-len];
+        memset(share->random, 0, share->prime_len-len);
+        memcpy(r, secret, len);
+        secret += len;
+        err = share->meth->num_from_bin(share->ctx, share->random,
+            share->prime_len, num[0]);
+        if (err != NONE) goto end;
+
+        /* Create number objects with the data for the random coefficients.
+         */
+        for (i=1; i<share->parts; i++)
+        {
+            if (share_random(share, r, len) != 0)
+            {
+                err = RANDOM;
+                goto end;
+            }
+            if (b == 0)
+                r[0] &= share->mask;
+            err = share->meth->num_from_bin(share->ctx, share->random,
+                share->prime_len, num[i]);
+            if (err != NONE) goto end;
+        }
     }
 
-    /* The first coefficient is the secret. */
-    r = &share->random[share->prime_len-share->len];
-    memset(share->random, 0, share->prime_len-share->len);
-    memcpy(r, secret, share->len);
-    err = share->meth->num_from_bin(share->random, share->prime_len,
-        share->num[0]);
+    /* Initialize the count of generated splits. */
+    share->cnt = 0;
+end:
+    return err;
+}
+
+/**
+ * Generate the split for the x ordinate held in the random buffer.
+ *
+ * @param [in] share  The share operation object.
+ * @param [in] data   The data of the generated split as big-endian bytes.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+static SHARE_ERR share_split_x(SHARE *share, uint8_t *data)
+{
+    SHARE_ERR err = NONE;
+    void *x = share->y[0];
+    uint16_t b;
+
+    err = share->meth->num_from_bin(share->ctx, share->random,
+        share->prime_len, x);
+    if (err != NONE) goto end;
+
+    /* Encode the x ordinate once for all the blocks. */
+    err = share->meth->num_to_bin(share->ctx, x, data, share->prime_len);
     if (err != NONE) goto end;
+    data += share->prime_len;
 
-    /* Create number objects with the data for the random coefficients. */
-    for (i=1; i<share->parts; i++)
+    for (b=0; b<share->blocks; b++)
     {
-        memcpy(r, &t[share->len * (i-1)], share->len);
-        r[0] &= share->mask;
-        err = share->meth->num_from_bin(share->random, share->prime_len,
-            share->num[i]);
+        /* Calculate the corresponding y using the coefficients. */
+        err = share->meth->split(share->ctx, share->prime, share->parts,
+            &share->num[b*share->parts], x, share->res);
+        if (err != NONE) goto end;
+
+        /* Encode the y ordinate. */
+        err = share->meth->num_to_bin(share->ctx, share->res, data,
+            share->prime_len);
         if (err != NONE) goto end;
+        data += share->prime_len;
     }
 
-    /* Initialize the count of generated splits. */
-    share->cnt = 0;
+    share->cnt++;
 end:
-    if (t != NULL) free(t);
     return err;
 }
 
 /**
  * Generate a split for the secret.
- * A random x is generated. There is a small chance that an x will be repeated.
+ * A random, non-zero x is generated. There is a small chance that an x will
+ * be repeated. Not supported in the compact format, where the x is only 16
+ * bits and repeats are likely: use SHARE_split_at_n() with distinct x
+ * ordinates instead.
  *
  * @param [in] share  The share operation object.
  * @param [in] data   The data of the generated split as big-endian bytes.
  * @return  PARAM_NULL when a parameter is NULL.<br>
+ *          PARAM_BAD_VALUE when the format is compact.<br>
  *          ALLOC when dynamic memory allocation fails.<br>
  *          RANDOM when the random number generator fails.<br>
  *          NONE otherwise.
@@ -475,41 +847,195 @@ end:
 SHARE_ERR SHARE_split(SHARE *share, uint8_t *data)
 {
     SHARE_ERR err = NONE;
-    void *x;
-    uint8_t *r;
+    uint16_t i, len;
+    uint8_t *r, bits;
 
     if ((share == NULL) || (data == NULL))
     {
         err = PARAM_NULL;
         goto end;
     }
+    if (share->format == SHARE_FORMAT_COMPACT)
+    {
+        err = PARAM_BAD_VALUE;
+        goto end;
+    }
+
+    /* The x is no longer than a block. */
+    len = share_block_len(share, share->blocks-1);
+    r = &share->random[share->prime_len-len];
+    memset(share->random, 0, share->prime_len-len);
+
+    /* Generate a random x, again when zero as the split at zero is the
+     * secret. */
+    do
+    {
+        if (share_random(share, r, len) != 0)
+        {
+            err = RANDOM;
+            goto end;
+        }
+        if (share->blocks == 1)
+            r[0] &= share->mask;
+        bits = 0;
+        for (i=0; i<len; i++)
+            bits |= r[i];
+    }
+    while (bits == 0);
+    err = share_split_x(share, data);
+end:
+    return err;
+}
+
+/**
+ * Generate the split for the secret at the x ordinate specified.
+ * Distinct x ordinates give distinct splits.
+ *
+ * @param [in] share  The share operation object.
+ * @param [in] x      The x ordinate of the split. Must not be zero.
+ * @param [in] data   The data of the generated split as big-endian bytes.
+ * @return  PARAM_NULL when a parameter is NULL.<br>
+ *          PARAM_BAD_VALUE when x is zero.<br>
+ *          ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR SHARE_split_at(SHARE *share, uint16_t x, uint8_t *data)
+{
+    return SHARE_split_at_n(share, &x, 1, &data);
+}
+
+/**
+ * Encode the 16-bit x ordinate of a split.
+ *
+ * @param [in] share  The share operation object.
+ * @param [in] x      The x ordinate.
+ * @param [in] data   The data of the split as big-endian bytes.
+ * @return  The length of the encoded x ordinate in bytes.
+ */
+static uint16_t share_x_encode(SHARE *share, uint16_t x, uint8_t *data)
+{
+    uint16_t len = share->prime_len;
+
+    if (share->format == SHARE_FORMAT_COMPACT)
+    {
+        data[0] = SHARE_COMPACT_VERSION;
+        len = SHARE_COMPACT_X_LEN;
+    }
+    else
+        memset(data, 0, len-2);
+    data[len-2] = x >> 8;
+    data[len-1] = x & 0xff;
+    return len;
+}
+
+/**
+ * Calculate the y ordinates of a batch of splits of a block into the y
+ * numbers of the object.
+ *
+ * @param [in] share  The share operation object.
+ * @param [in] a      The coefficients of the block.
+ * @param [in] x      The x ordinates of the splits.
+ * @param [in] n      The number of splits, at most SHARE_SPLIT_BATCH.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+static SHARE_ERR share_split_batch(SHARE *share, void **a, const uint16_t *x,
+    int n)
+{
+    SHARE_ERR err = NONE;
+    uint8_t xd[2];
+    int i;
+
+    if (share->meth->split_batch != NULL)
+    {
+        err = share->meth->split_batch(share->ctx, share->prime, share->parts,
+            a, x, share->ys, n);
+        goto end;
+    }
 
-    x = share->y[0];
-    r = &share->random[share->prime_len-share->len];
+    /* One split at a time, the x ordinate decoded into the result number. */
+    for (i=0; i<n; i++)
+    {
+        xd[0] = x[i] >> 8;
+        xd[1] = x[i] & 0xff;
+        err = share->meth->num_from_bin(share->ctx, xd, 2, share->res);
+        if (err != NONE) goto end;
+        err = share->meth->split(share->ctx, share->prime, share->parts, a,
+            share->res, share->ys[i]);
+        if (err != NONE) goto end;
+    }
+end:
+    return err;
+}
 
-    /* Generate a random x. */
-    if (SHARE_random(r, share->len) != 0)
+/**
+ * Generate the splits for the secret at the x ordinates specified.
+ * The splits are calculated in batches, all the x ordinates of a batch in
+ * one pass over the coefficients of each block.
+ * Distinct x ordinates give distinct splits. This is how splits are
+ * generated in the compact format.
+ *
+ * @param [in] share  The share operation object.
+ * @param [in] x      The x ordinates of the splits. Must not be zero.
+ * @param [in] n      The number of splits to generate.
+ * @param [in] data   The data of each generated split as big-endian bytes.
+ * @return  PARAM_NULL when a parameter is NULL.<br>
+ *          PARAM_BAD_VALUE when an x is zero.<br>
+ *          ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR SHARE_split_at_n(SHARE *share, const uint16_t *x, int n,
+    uint8_t **data)
+{
+    SHARE_ERR err = NONE;
+    uint16_t b, x_len = 0;
+    int i, j, cnt;
+
+    if ((share == NULL) || (x == NULL) || (data == NULL))
     {
-        err = RANDOM;
+        err = PARAM_NULL;
         goto end;
     }
-    r[0] &= share->mask;
-    err = share->meth->num_from_bin(share->random, share->prime_len, x);
-    if (err != NONE) goto end;
+    for (i=0; i<n; i++)
+    {
+        if (data[i] == NULL)
+        {
+            err = PARAM_NULL;
+            goto end;
+        }
+        /* The split at zero is the secret. */
+        if (x[i] == 0)
+        {
+            err = PARAM_BAD_VALUE;
+            goto end;
+        }
+    }
 
-    /* Calculate the corresponding y using the coefficients. */
-    err = share->meth->split(share->prime, share->parts, share->num, x,
-        share->res);
-    if (err != NONE) goto end;
+    for (i=0; i<n; i+=cnt)
+    {
+        cnt = n - i;
+        if (cnt > SHARE_SPLIT_BATCH)
+            cnt = SHARE_SPLIT_BATCH;
 
-    /* Encode the x and y ordinates. */
-    err = share->meth->num_to_bin(x, data, share->prime_len);
-    if (err != NONE) goto end;
-    data += share->prime_len;
-    err = share->meth->num_to_bin(share->res, data, share->prime_len);
-    if (err != NONE) goto end;
+        for (j=0; j<cnt; j++)
+            x_len = share_x_encode(share, x[i+j], data[i+j]);
+        for (b=0; b<share->blocks; b++)
+        {
+            err = share_split_batch(share, &share->num[b*share->parts], &x[i],
+                cnt);
+            if (err != NONE) goto end;
 
-    share->cnt++;
+            /* Encode the y ordinates of the block. */
+            for (j=0; j<cnt; j++)
+            {
+                err = share->meth->num_to_bin(share->ctx, share->ys[j],
+                    data[i+j] + x_len + b * share->prime_len,
+                    share->prime_len);
+                if (err != NONE) goto end;
+            }
+        }
+        share->cnt += cnt;
+    }
 end:
     return err;
 }
@@ -544,12 +1070,16 @@ end:
  * @param [in] share  The share operation object.
  * @param [in] data   The data of the generated split as big-endian bytes.
  * @return  PARAM_NULL when a parameter is NULL.<br>
+ *          INVALID_DATA when the version of a compact split is not supported.
+ *          <br>
  *          ALLOC when dynamic memory allocation fails.<br>
  *          NONE otherwise.
  */
 SHARE_ERR SHARE_join_update(SHARE *share, uint8_t *data)
 {
     SHARE_ERR err = NONE;
+    uint16_t b;
+    int i;
 
     if ((share == NULL) || (data == NULL))
     {
@@ -559,22 +1089,155 @@ SHARE_ERR SHARE_join_update(SHARE *share, uint8_t *data)
     if (share->parts == share->cnt)
         goto end;
 
-    /* Split is an x and a y ordinate. */
+    /* Split is an x and a y ordinate for each block. */
     /* X */
-    err = share->meth->num_from_bin(data, share->prime_len,
-        share->num[share->cnt]);
-    if (err != NONE) goto end;
-    data += share->prime_len;
+    if (share->format == SHARE_FORMAT_COMPACT)
+    {
+        if (data[0] != SHARE_COMPACT_VERSION)
+        {
+            err = INVALID_DATA;
+            goto end;
+        }
+        err = share->meth->num_from_bin(share->ctx, &data[1], 2,
+            share->num[share->cnt]);
+        if (err != NONE) goto end;
+        share->xs[share->cnt] = (data[1] << 8) | data[2];
+        data += SHARE_COMPACT_X_LEN;
+    }
+    else
+    {
+        err = share->meth->num_from_bin(share->ctx, data, share->prime_len,
+            share->num[share->cnt]);
+        if (err != NONE) goto end;
+        /* Splits made at an x ordinate have a 16-bit integer. */
+        share->xs[share->cnt] = 0;
+        for (i=0; (i<share->prime_len-2) && (data[i] == 0); i++)
+            ;
+        if (i == share->prime_len-2)
+            share->xs[share->cnt] = (data[i] << 8) | data[i+1];
+        data += share->prime_len;
+    }
     /* Y */
-    err = share->meth->num_from_bin(data, share->prime_len,
-        share->y[share->cnt]);
-    if (err != NONE) goto end;
+    for (b=0; b<share->blocks; b++)
+    {
+        err = share->meth->num_from_bin(share->ctx, data, share->prime_len,
+            share->y[b*share->parts+share->cnt]);
+        if (err != NONE) goto end;
+        data += share->prime_len;
+    }
 
     share->cnt++;
 end:
     return err;
 }
 
+/**
+ * Encode the calculated block of the secret.
+ *
+ * @param [in] share   The share operation object.
+ * @param [in] b       The index of the block.
+ * @param [in] secret  The data of the block as big-endian bytes.
+ * @return  FAILED when the secret calculated is larger than expected.<br>
+ *          NONE otherwise.
+ */
+static SHARE_ERR share_secret_encode(SHARE *share, uint16_t b,
+    uint8_t *secret)
+{
+    SHARE_ERR err;
+    uint16_t len = share_block_len(share, b);
+    int16_t o;
+    int i;
+
+    /* Encode the number up to prime length bytes. */
+    err = share->meth->num_to_bin(share->ctx, share->res, share->random,
+        share->prime_len);
+    if (err != NONE) goto end;
+
+    /* Offset to the start of the secret. */
+    o = share->prime_len-len;
+    /* Check that the calculated secret isn't too large. */
+    for (i=0; i<o; i++)
+    {
+        if (share->random[i] != 0)
+        {
+            err = FAILED;
+            goto end;
+        }
+    }
+
+    memcpy(secret, &share->random[o], len);
+end:
+    return err;
+}
+
+/**
+ * Check whether the weights of the splits added can be calculated from small
+ * integer x ordinates.
+ *
+ * @param [in] share  The share operation object.
+ * @return  1 when the implementation supports it and all the x ordinates are
+ *          small integers.<br>
+ *          0 otherwise.
+ */
+static int share_small(SHARE *share)
+{
+    int i;
+
+    if (share->meth->weights_small == NULL)
+        return 0;
+    for (i=0; i<share->parts; i++)
+    {
+        if ((share->xs[i] == 0) || (share->xs[i] > SHARE_SMALL_MAX))
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Calculate the weights of the splits added, from the small integer x
+ * ordinates when possible.
+ *
+ * @param [in] share  The share operation object.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          MOD_INV when the x ordinates are not distinct and non-zero.<br>
+ *          NONE otherwise.
+ */
+static SHARE_ERR share_weights(SHARE *share)
+{
+    if (share_small(share))
+        return share->meth->weights_small(share->ctx, share->prime,
+            share->parts, share->xs, share->w);
+    return share->meth->weights(share->ctx, share->prime, share->parts,
+        share->num, share->w);
+}
+
+/**
+ * Calculate the secret from the weights of the splits, block by block.
+ *
+ * @param [in] share   The share operation object.
+ * @param [in] secret  The data of the secret as big-endian bytes.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          FAILED when the secret calculated is larger than expected.<br>
+ *          NONE otherwise.
+ */
+static SHARE_ERR share_combine_blocks(SHARE *share, uint8_t *secret)
+{
+    SHARE_ERR err = NONE;
+    uint16_t b;
+
+    for (b=0; b<share->blocks; b++)
+    {
+        err = share->meth->combine(share->ctx, share->prime, share->parts,
+            share->w, &share->y[b*share->parts], share->res);
+        if (err != NONE) goto end;
+        err = share_secret_encode(share, b, secret);
+        if (err != NONE) goto end;
+        secret += share_block_len(share, b);
+    }
+end:
+    return err;
+}
+
 /**
  * Calculate the secret from the splits.
  *
@@ -590,8 +1253,6 @@ end:
 SHARE_ERR SHARE_join_final(SHARE *share, uint8_t *secret)
 {
     SHARE_ERR err = NONE;
-    int16_t o;
-    int i;
 
     if ((share == NULL) || (secret == NULL))
     {
@@ -605,28 +1266,114 @@ SHARE_ERR SHARE_join_final(SHARE *share, uint8_t *secret)
         goto end;
     }
 
-    err = share->meth->join(share->prime, share->parts, share->num, share->y,
-        share->res);
-    if (err != NONE) goto end;
+    if ((share->blocks == 1) && !share_small(share))
+    {
+        err = share->meth->join(share->ctx, share->prime, share->parts,
+            share->num, share->y, share->res);
+        if (err != NONE) goto end;
 
-    /* Encode the number up to prime length bytes. */
-    err = share->meth->num_to_bin(share->res, share->random, share->prime_len);
-    if (err != NONE) goto end;
+        err = share_secret_encode(share, 0, secret);
+    }
+    else
+    {
+        /* One set of weights for all the blocks. */
+        err = share_weights(share);
+        if (err != NONE) goto end;
 
-    /* Offset to the start of the secret. */
-    o = share->prime_len-share->len;
-    /* Check that the calculated secret isn't too large. */
-    for (i=0; i<o; i++)
+        err = share_combine_blocks(share, secret);
+    }
+end:
+    return err;
+}
+
+/**
+ * Calculate the weights of the splits added for joining.
+ * The weights only depend on the x ordinates, so they can be kept and passed
+ * to SHARE_join_final_weights() when splits with the same x ordinates are
+ * joined again.
+ *
+ * @param [in] share    The share operation object.
+ * @param [in] weights  The weights as big-endian bytes. One number for each
+ *                      part, each as long as the prime (prime_len bytes).
+ * @return  PARAM_NULL when a parameter is NULL.<br>
+ *          ALLOC when dynamic memory allocation fails.<br>
+ *          INVALID_DATA when the number of splits added is less than the number
+ *          required (parts).<br>
+ *          MOD_INV when the x ordinates are not distinct and non-zero.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR SHARE_join_weights(SHARE *share, uint8_t *weights)
+{
+    SHARE_ERR err = NONE;
+    int i;
+
+    if ((share == NULL) || (weights == NULL))
     {
-        if (share->random[i] != 0)
-        {
-            err = FAILED;
-            goto end;
-        }
+        err = PARAM_NULL;
+        goto end;
+    }
+    /* Must have parts number of splits to be able to calcuate weights. */
+    if (share->cnt < share->parts)
+    {
+        err = INVALID_DATA;
+        goto end;
     }
 
-    memcpy(secret, &share->random[o], share->len);
+    err = share_weights(share);
+    if (err != NONE) goto end;
+
+    for (i=0; i<share->parts; i++)
+    {
+        err = share->meth->num_to_bin(share->ctx, share->w[i], weights,
+            share->prime_len);
+        if (err != NONE) goto end;
+        weights += share->prime_len;
+    }
 end:
     return err;
 }
 
+/**
+ * Calculate the secret from the splits using weights calculated by
+ * SHARE_join_weights() for splits with the same x ordinates in the same order.
+ *
+ * @param [in] share    The share operation object.
+ * @param [in] weights  The weights as big-endian bytes.
+ * @param [in] secret   The data of the secret as big-endian bytes.
+ * @return  PARAM_NULL when a parameter is NULL.<br>
+ *          ALLOC when dynamic memory allocation fails.<br>
+ *          INVALID_DATA when the number of splits added is less than the number
+ *          required (parts).<br>
+ *          FAILED when the secret calculated is larger than expected.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR SHARE_join_final_weights(SHARE *share, const uint8_t *weights,
+    uint8_t *secret)
+{
+    SHARE_ERR err = NONE;
+    int i;
+
+    if ((share == NULL) || (weights == NULL) || (secret == NULL))
+    {
+        err = PARAM_NULL;
+        goto end;
+    }
+    /* Must have parts number of splits to be able to calcuate secret. */
+    if (share->cnt < share->parts)
+    {
+        err = INVALID_DATA;
+        goto end;
+    }
+
+    for (i=0; i<share->parts; i++)
+    {
+        err = share->meth->num_from_bin(share->ctx, weights, share->prime_len,
+            share->w[i]);
+        if (err != NONE) goto end;
+        weights += share->prime_len;
+    }
+
+    err = share_combine_blocks(share, secret);
+end:
+    return err;
+}
@@ -30,22 +30,49 @@ typedef enum share_err_en {
     MOD_INV             = 41
 } SHARE_ERR;
 
+/** The formats of an encoded split. */
+typedef enum share_format_en {
+    /** The x ordinate and the y ordinate of each block, each as long as the
+     * prime. */
+    SHARE_FORMAT_FULL		= 0,
+    /** A version byte, the x ordinate in two bytes and the y ordinate of each
+     * block. */
+    SHARE_FORMAT_COMPACT	= 1
+} SHARE_FORMAT;
+
 /** The structure for splitting and joining */
 typedef struct share_st SHARE;
 
+/**
+ * Random number generator callback: fill r with len random bytes.
+ * Returns 0 on success.
+ */
+typedef int (*SHARE_RANDOM_FUNC)(void *ctx, unsigned char *r, int len);
+
 SHARE_ERR SHARE_new(uint16_t len, uint8_t parts, SHARE **share);
+SHARE_ERR SHARE_new_impl(uint16_t len, uint8_t parts, const char *name,
+    SHARE **share);
 void SHARE_free(SHARE *share);
+SHARE_ERR SHARE_clear(SHARE *share);
 
 SHARE_ERR SHARE_get_len(SHARE *share, uint16_t *len);
 SHARE_ERR SHARE_get_num(SHARE *share, uint16_t *num);
 SHARE_ERR SHARE_get_impl_name(SHARE *share, char **name);
+SHARE_ERR SHARE_set_random(SHARE *share, SHARE_RANDOM_FUNC func, void *ctx);
+SHARE_ERR SHARE_set_format(SHARE *share, SHARE_FORMAT format);
 
 SHARE_ERR SHARE_split_init(SHARE *share, uint8_t *secret);
 SHARE_ERR SHARE_split(SHARE *share, uint8_t *data);
+SHARE_ERR SHARE_split_at(SHARE *share, uint16_t x, uint8_t *data);
+SHARE_ERR SHARE_split_at_n(SHARE *share, const uint16_t *x, int n,
+    uint8_t **data);
 
 SHARE_ERR SHARE_join_init(SHARE *share);
 SHARE_ERR SHARE_join_update(SHARE *share, uint8_t *data);
 SHARE_ERR SHARE_join_final(SHARE *share, uint8_t *secret);
+SHARE_ERR SHARE_join_weights(SHARE *share, uint8_t *weights);
+SHARE_ERR SHARE_join_final_weights(SHARE *share, const uint8_t *weights,
+    uint8_t *secret);
 
 
 SHARE_ERR SHARE_random(unsigned char *a, int len);
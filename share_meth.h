@@ -20,31 +20,59 @@ typedef void (SHARE_NUM_FREE_FUNC)(void *num);
 /**
  * The prototype of a function that decodes data into a number object.
  * The data is assumed to be big-endian bytes.
+ * The number is in the representation the calculations use, unless ctx is
+ * NULL.
  *
+ * @param [in] ctx   The context of the share operations object. May be NULL.
  * @param [in] data  The data to be decoded.
  * @param [in] len   The length of the data to be decoded.
  * @param [in] num   The number object.
  * @return  ALLOC when dynamic memory allocation fails.<br>
  *          NONE otherwise.
  */
-typedef SHARE_ERR (SHARE_NUM_FROM_BIN_FUNC)(const uint8_t *data, uint16_t len,
-    void *num);
+typedef SHARE_ERR (SHARE_NUM_FROM_BIN_FUNC)(void *ctx, const uint8_t *data,
+    uint16_t len, void *num);
 /**
  * The prototype of a function that encodes a number object into data.
  * The data is assumed to be big-endian bytes.
+ * The number is in the representation the calculations use, unless ctx is
+ * NULL.
  *
+ * @param [in] ctx   The context of the share operations object. May be NULL.
  * @param [in] num   The number object.
  * @param [in] data  The data to hold the encoding.
  * @param [in] len   The number of bytes that data can hold.
  * @return  PARAM_BAD_LEN when encoding is too long for data.<br>
  *          NONE otherwise.
  */
-typedef SHARE_ERR (SHARE_NUM_TO_BIN_FUNC)(void *num, uint8_t *data,
+typedef SHARE_ERR (SHARE_NUM_TO_BIN_FUNC)(void *ctx, void *num, uint8_t *data,
     uint16_t len);
+/**
+ * The prototype of a function that creates the context of a share operations
+ * object. The context holds the temporaries of the calculations for the
+ * lifetime of the object so that splitting and joining don't allocate.
+ *
+ * @param [in]  prime  The prime as a number object.
+ * @param [in]  parts  The number of parts that are required to recalcuate
+ *                     secret.
+ * @param [out] ctx    The new context.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+typedef SHARE_ERR (SHARE_CTX_NEW_FUNC)(void *prime, uint8_t parts,
+    void **ctx);
+/**
+ * The prototype of a function that frees the context of a share operations
+ * object.
+ *
+ * @param [in] ctx  The context.
+ */
+typedef void (SHARE_CTX_FREE_FUNC)(void *ctx);
 /**
  * The prototype of a function that calculates the y value of a split.
  * y = x^0.a[0] + x^1.a[1] + ... + x^(parts-1).a[parts-1]
  *
+ * @param [in] ctx    The context of the share operations object.
  * @param [in] prime  The prime as a number object.
  * @param [in] parts  The number of parts that are required to recalcuate
  *                    secret.
@@ -54,13 +82,34 @@ typedef SHARE_ERR (SHARE_NUM_TO_BIN_FUNC)(void *num, uint8_t *data,
  * @return  ALLOC when dynamic memory allocation fails.<br>
  *          NONE otherwise.
  */
-typedef SHARE_ERR (SHARE_SPLIT_FUNC)(void *prime, uint8_t parts, void **a,
-    void *x, void *y);
+typedef SHARE_ERR (SHARE_SPLIT_FUNC)(void *ctx, void *prime, uint8_t parts,
+    void **a, void *x, void *y);
+/**
+ * The prototype of a function that calculates the y values of the splits at
+ * several x values in one pass. The x values are 16-bit integers, so the
+ * multiplications by them are short and those of the different x values are
+ * independent.
+ * y[i] = x[i]^0.a[0] + x[i]^1.a[1] + ... + x[i]^(parts-1).a[parts-1]
+ *
+ * @param [in] ctx    The context of the share operations object.
+ * @param [in] prime  The prime as a number object.
+ * @param [in] parts  The number of parts that are required to recalcuate
+ *                    secret.
+ * @param [in] a      The array of coefficients.
+ * @param [in] x      The array of x values.
+ * @param [in] y      The array of y values as number objects.
+ * @param [in] n      The number of x values.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+typedef SHARE_ERR (SHARE_SPLIT_BATCH_FUNC)(void *ctx, void *prime,
+    uint8_t parts, void **a, const uint16_t *x, void **y, int n);
 /**
  * The prototype of a function that calculates the secret from splits.
  * secret = sum of (i=0..parts-1) y[i] *
  *          product of (j=0..parts-1) x[j] / (x[j] - x[i]) where j != i
  *
+ * @param [in] ctx     The context of the share operations object.
  * @param [in] prime   The prime as a number object.
  * @param [in] parts   The number of parts that are required to recalcuate
  *                     secret.
@@ -68,10 +117,71 @@ typedef SHARE_ERR (SHARE_SPLIT_FUNC)(void *prime, uint8_t parts, void **a,
  * @param [in] y       The array of y values as number objects.
  * @param [in] secret  The calculated secret as a number object.
  * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          MOD_INV when the x values are not distinct and non-zero.<br>
  *          NONE otherwise.
  */
-typedef SHARE_ERR (SHARE_JOIN_FUNC)(void *prime, uint8_t parts, void **x,
-    void **y, void *secret);
+typedef SHARE_ERR (SHARE_JOIN_FUNC)(void *ctx, void *prime, uint8_t parts,
+    void **x, void **y, void *secret);
+
+/**
+ * The prototype of a function that calculates the weights of the splits.
+ * The weights only depend on the x values, so joining splits with the same x
+ * values again only needs the weighted sum.
+ * w[i] = product of (j=0..parts-1) x[j] / (x[j] - x[i]) where j != i
+ *
+ * @param [in] ctx    The context of the share operations object.
+ * @param [in] prime  The prime as a number object.
+ * @param [in] parts  The number of parts that are required to recalcuate
+ *                    secret.
+ * @param [in] x      The array of x values as number objects.
+ * @param [in] w      The array of weights as number objects.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          MOD_INV when the x values are not distinct and non-zero.<br>
+ *          NONE otherwise.
+ */
+typedef SHARE_ERR (SHARE_WEIGHTS_FUNC)(void *ctx, void *prime, uint8_t parts,
+    void **x, void **w);
+/**
+ * The prototype of a function that calculates the secret from the weights
+ * and the y values of the splits.
+ * secret = sum of (i=0..parts-1) w[i] * y[i]
+ *
+ * @param [in] ctx     The context of the share operations object.
+ * @param [in] prime   The prime as a number object.
+ * @param [in] parts   The number of parts that are required to recalcuate
+ *                     secret.
+ * @param [in] w       The array of weights as number objects.
+ * @param [in] y       The array of y values as number objects.
+ * @param [in] secret  The calculated secret as a number object.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+typedef SHARE_ERR (SHARE_COMBINE_FUNC)(void *ctx, void *prime, uint8_t parts,
+    void **w, void **y, void *secret);
+
+/** The largest x value that the weights of small x values support. */
+#define SHARE_SMALL_MAX		255
+
+/**
+ * The prototype of a function that calculates the weights of the splits when
+ * the x values are small integers. The differences of the x values are small
+ * integers too, so their inverses can be looked up instead of calculated.
+ * w[i] = product of (j=0..parts-1) x[j] / (x[j] - x[i]) where j != i
+ *
+ * @param [in] ctx    The context of the share operations object.
+ * @param [in] prime  The prime as a number object.
+ * @param [in] parts  The number of parts that are required to recalcuate
+ *                    secret.
+ * @param [in] x      The array of x values, 1 to SHARE_SMALL_MAX.
+ * @param [in] w      The array of weights as number objects.
+ * @return  PARAM_BAD_VALUE when an x value is greater than SHARE_SMALL_MAX.
+ *          <br>
+ *          ALLOC when dynamic memory allocation fails.<br>
+ *          MOD_INV when the x values are not distinct and non-zero.<br>
+ *          NONE otherwise.
+ */
+typedef SHARE_ERR (SHARE_WEIGHTS_SMALL_FUNC)(void *ctx, void *prime,
+    uint8_t parts, const uint16_t *x, void **w);
 
 /** The data structure of an implementation method. */
 typedef struct share_meth_st
@@ -90,20 +200,85 @@ typedef struct share_meth_st
     SHARE_NUM_FROM_BIN_FUNC *num_from_bin;
     /** Encodes a number object into data. */
     SHARE_NUM_TO_BIN_FUNC *num_to_bin;
+    /** Creates the context of a share operations object. */
+    SHARE_CTX_NEW_FUNC *ctx_new;
+    /** Frees the context of a share operations object. */
+    SHARE_CTX_FREE_FUNC *ctx_free;
     /** Calculates the y value of a split. */
     SHARE_SPLIT_FUNC *split;
     /** Calculates the secret from splits. */
     SHARE_JOIN_FUNC *join;
+    /** Calculates the weights of splits. */
+    SHARE_WEIGHTS_FUNC *weights;
+    /** Calculates the secret from weights and splits. */
+    SHARE_COMBINE_FUNC *combine;
+    /** Calculates the weights of splits with small x values. Optional:
+     * weights is used when NULL. */
+    SHARE_WEIGHTS_SMALL_FUNC *weights_small;
+    /** Calculates the y values of splits at several x values. Optional:
+     * split is used for each x value when NULL. */
+    SHARE_SPLIT_BATCH_FUNC *split_batch;
 } SHARE_METH;
 
 /* The generic implementation that uses OpenSSL. */
 SHARE_ERR share_openssl_num_new(uint16_t len, void **num);
 void share_openssl_num_free(void *num);
-SHARE_ERR share_openssl_num_from_bin(const uint8_t *data, uint16_t len,
-    void *num);
-SHARE_ERR share_openssl_num_to_bin(void *num, uint8_t *data, uint16_t len);
-SHARE_ERR share_openssl_split(void *prime, uint8_t parts, void **a, void *x,
-    void *y);
-SHARE_ERR share_openssl_join(void *prime, uint8_t parts, void **x, void **y,
-    void *secret);
+SHARE_ERR share_openssl_num_from_bin(void *ctx, const uint8_t *data,
+    uint16_t len, void *num);
+SHARE_ERR share_openssl_num_to_bin(void *ctx, void *num, uint8_t *data,
+    uint16_t len);
+SHARE_ERR share_openssl_ctx_new(void *prime, uint8_t parts, void **ctx);
+void share_openssl_ctx_free(void *ctx);
+SHARE_ERR share_openssl_split(void *ctx, void *prime, uint8_t parts, void **a,
+    void *x, void *y);
+SHARE_ERR share_openssl_join(void *ctx, void *prime, uint8_t parts, void **x,
+    void **y, void *secret);
+SHARE_ERR share_openssl_weights(void *ctx, void *prime, uint8_t parts,
+    void **x, void **w);
+SHARE_ERR share_openssl_combine(void *ctx, void *prime, uint8_t parts,
+    void **w, void **y, void *secret);
+
+/* The implementation that uses OpenSSL with Montgomery multiplication. */
+SHARE_ERR share_openssl_mont_num_from_bin(void *ctx, const uint8_t *data,
+    uint16_t len, void *num);
+SHARE_ERR share_openssl_mont_num_to_bin(void *ctx, void *num, uint8_t *data,
+    uint16_t len);
+SHARE_ERR share_openssl_mont_ctx_new(void *prime, uint8_t parts, void **ctx);
+SHARE_ERR share_openssl_mont_split(void *ctx, void *prime, uint8_t parts,
+    void **a, void *x, void *y);
+SHARE_ERR share_openssl_mont_join(void *ctx, void *prime, uint8_t parts,
+    void **x, void **y, void *secret);
+SHARE_ERR share_openssl_mont_weights(void *ctx, void *prime, uint8_t parts,
+    void **x, void **w);
+SHARE_ERR share_openssl_mont_combine(void *ctx, void *prime, uint8_t parts,
+    void **w, void **y, void *secret);
+
+#if defined(__SIZEOF_INT128__)
+/** The native implementation needs 128-bit products of 64-bit limbs. */
+#define SHARE_NATIVE
+#endif
+
+#if defined(SHARE_NATIVE)
+/* The native implementation for the built-in pseudo-Mersenne primes. */
+SHARE_ERR share_native_num_new(uint16_t len, void **num);
+void share_native_num_free(void *num);
+SHARE_ERR share_native_num_from_bin(void *ctx, const uint8_t *data,
+    uint16_t len, void *num);
+SHARE_ERR share_native_num_to_bin(void *ctx, void *num, uint8_t *data,
+    uint16_t len);
+SHARE_ERR share_native_ctx_new(void *prime, uint8_t parts, void **ctx);
+void share_native_ctx_free(void *ctx);
+SHARE_ERR share_native_split(void *ctx, void *prime, uint8_t parts,
+    void **a, void *x, void *y);
+SHARE_ERR share_native_join(void *ctx, void *prime, uint8_t parts, void **x,
+    void **y, void *secret);
+SHARE_ERR share_native_weights(void *ctx, void *prime, uint8_t parts,
+    void **x, void **w);
+SHARE_ERR share_native_combine(void *ctx, void *prime, uint8_t parts,
+    void **w, void **y, void *secret);
+SHARE_ERR share_native_weights_small(void *ctx, void *prime, uint8_t parts,
+    const uint16_t *x, void **w);
+SHARE_ERR share_native_split_batch(void *ctx, void *prime, uint8_t parts,
+    void **a, const uint16_t *x, void **y, int n);
+#endif
 #endif /* SSS_SHARE_METH_H */
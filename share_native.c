@@ -0,0 +1,912 @@
+#include <stdlib.h>
+#include <string.h>
+#include "share_meth.h"
+
+#if defined(SHARE_NATIVE)
+
+/*
+ * The built-in primes are p = 2^B - c where B = 64.(limbs-1) + 1 and c is
+ * less than 255. Numbers are fixed arrays of 64-bit limbs, least significant
+ * first, always less than p. A product is reduced by folding the bits above
+ * B back in multiplied by c, as 2^B = c mod p.
+ */
+
+/** The maximum number of 64-bit limbs in a number. */
+#define SHARE_NATIVE_LIMBS  5
+
+/** Double width limb to hold products and carries. */
+__extension__ typedef unsigned __int128 share_native_dword;
+
+/** The number object of the native implementation. */
+typedef struct share_native_num_st
+{
+    /** The limbs of the number, least significant first. */
+    uint64_t l[SHARE_NATIVE_LIMBS];
+} SHARE_NATIVE_NUM;
+
+/** The prime of a share operations object in the form the calculations use.
+ */
+typedef struct share_native_ctx_st
+{
+    /** The number of limbs of the prime. */
+    int limbs;
+    /** The prime is 2^B - c. */
+    uint64_t c;
+    /** The limbs of the prime. */
+    uint64_t p[SHARE_NATIVE_LIMBS];
+    /** The inverses of 0 to SHARE_SMALL_MAX, 0 having none. Calculated when
+     * first needed. */
+    SHARE_NATIVE_NUM *inv;
+} SHARE_NATIVE_CTX;
+
+/**
+ * Clear memory holding numbers, even when it is not read again.
+ *
+ * @param [in] p    The memory to clear.
+ * @param [in] len  The length of the memory in bytes.
+ */
+static void share_native_clear(void *p, size_t len)
+{
+    volatile uint8_t *v = p;
+
+    while (len-- > 0)
+        *v++ = 0;
+}
+
+/**
+ * Subtract the prime when the number is not less than it.
+ * Constant time.
+ *
+ * @param [in] r  The reduced number.
+ * @param [in] t  The number less than twice the prime.
+ * @param [in] p  The limbs of the prime.
+ * @param [in] n  The number of limbs.
+ */
+static inline void share_native_reduce_once(uint64_t *r, const uint64_t *t,
+    const uint64_t *p, int n)
+{
+    uint64_t u[SHARE_NATIVE_LIMBS];
+    uint64_t borrow = 0, mask;
+    share_native_dword s;
+    int i;
+
+    for (i=0; i<n; i++)
+    {
+        s = (share_native_dword)t[i] - p[i] - borrow;
+        u[i] = (uint64_t)s;
+        borrow = (uint64_t)(s >> 64) & 1;
+    }
+    /* All ones when t was less than p. */
+    mask = 0 - borrow;
+    for (i=0; i<n; i++)
+        r[i] = (t[i] & mask) | (u[i] & ~mask);
+}
+
+/**
+ * Fold the bits of the top limb above B into the bottom.
+ * t = (t mod 2^B) + (t >> B).c
+ *
+ * @param [in] t  The number to fold.
+ * @param [in] n  The number of limbs.
+ * @param [in] c  The prime is 2^B - c.
+ */
+static inline void share_native_fold(uint64_t *t, int n, uint64_t c)
+{
+    share_native_dword s;
+    int i;
+
+    s = (share_native_dword)(t[n-1] >> 1) * c;
+    t[n-1] &= 1;
+    for (i=0; i<n; i++)
+    {
+        s += t[i];
+        t[i] = (uint64_t)s;
+        s >>= 64;
+    }
+}
+
+/**
+ * Multiply two numbers modulo the prime 2^B - c.
+ * The result may be the same as an operand.
+ *
+ * @param [in] r  The product.
+ * @param [in] a  The first operand, less than the prime.
+ * @param [in] b  The second operand, less than the prime.
+ * @param [in] p  The limbs of the prime.
+ * @param [in] n  The number of limbs.
+ * @param [in] c  The prime is 2^B - c.
+ */
+static inline void share_native_mul_n(uint64_t *r, const uint64_t *a,
+    const uint64_t *b, const uint64_t *p, int n, uint64_t c)
+{
+    uint64_t v[2*SHARE_NATIVE_LIMBS];
+    uint64_t t[SHARE_NATIVE_LIMBS];
+    share_native_dword s;
+    uint64_t h, l;
+    int i, j;
+
+    for (i=0; i<n; i++)
+        v[i] = 0;
+    for (i=0; i<n; i++)
+    {
+        s = 0;
+        for (j=0; j<n; j++)
+        {
+            s += (share_native_dword)a[i] * b[j] + v[i+j];
+            v[i+j] = (uint64_t)s;
+            s >>= 64;
+        }
+        v[i+n] = (uint64_t)s;
+    }
+
+    /* t = (v mod 2^B) + (v >> B).c - less than 2^(B+8). */
+    s = 0;
+    for (i=0; i<n; i++)
+    {
+        h = (v[n-1+i] >> 1) | (v[n+i] << 63);
+        l = (i < n-1) ? v[i] : (v[i] & 1);
+        s += (share_native_dword)h * c + l;
+        t[i] = (uint64_t)s;
+        s >>= 64;
+    }
+    /* Less than 2^B + 2^16, then less than p. */
+    share_native_fold(t, n, c);
+    share_native_reduce_once(r, t, p, n);
+}
+
+/**
+ * Multiply two numbers modulo the prime.
+ * Each size of prime has its own unrolled code.
+ *
+ * @param [in] c  The context with the prime.
+ * @param [in] r  The product.
+ * @param [in] a  The first operand.
+ * @param [in] b  The second operand.
+ */
+static void share_native_mul(const SHARE_NATIVE_CTX *c, SHARE_NATIVE_NUM *r,
+    const SHARE_NATIVE_NUM *a, const SHARE_NATIVE_NUM *b)
+{
+    switch (c->limbs)
+    {
+    case 3:
+        share_native_mul_n(r->l, a->l, b->l, c->p, 3, c->c);
+        break;
+    case 4:
+        share_native_mul_n(r->l, a->l, b->l, c->p, 4, c->c);
+        break;
+    default:
+        share_native_mul_n(r->l, a->l, b->l, c->p, 5, c->c);
+        break;
+    }
+}
+
+/**
+ * Multiply a number by a 16-bit integer modulo the prime.
+ * The product is less than 2^(B+16), so one fold leaves it less than twice
+ * the prime.
+ *
+ * @param [in] c  The context with the prime.
+ * @param [in] r  The product. May be the same as a.
+ * @param [in] a  The number.
+ * @param [in] s  The integer.
+ */
+static void share_native_mul_small(const SHARE_NATIVE_CTX *c,
+    SHARE_NATIVE_NUM *r, const SHARE_NATIVE_NUM *a, uint16_t s)
+{
+    uint64_t t[SHARE_NATIVE_LIMBS];
+    share_native_dword m = 0;
+    int i;
+
+    /* The top limb of a is at most one: the product fits in the limbs. */
+    for (i=0; i<c->limbs; i++)
+    {
+        m += (share_native_dword)a->l[i] * s;
+        t[i] = (uint64_t)m;
+        m >>= 64;
+    }
+    share_native_fold(t, c->limbs, c->c);
+    share_native_reduce_once(r->l, t, c->p, c->limbs);
+}
+
+/**
+ * Add two numbers modulo the prime.
+ *
+ * @param [in] c  The context with the prime.
+ * @param [in] r  The sum.
+ * @param [in] a  The first operand.
+ * @param [in] b  The second operand.
+ */
+static void share_native_add(const SHARE_NATIVE_CTX *c, SHARE_NATIVE_NUM *r,
+    const SHARE_NATIVE_NUM *a, const SHARE_NATIVE_NUM *b)
+{
+    uint64_t t[SHARE_NATIVE_LIMBS];
+    share_native_dword s = 0;
+    int i;
+
+    /* Top limb of the prime is one: the sum can't overflow the limbs. */
+    for (i=0; i<c->limbs; i++)
+    {
+        s += (share_native_dword)a->l[i] + b->l[i];
+        t[i] = (uint64_t)s;
+        s >>= 64;
+    }
+    share_native_reduce_once(r->l, t, c->p, c->limbs);
+}
+
+/**
+ * Subtract a number from another modulo the prime.
+ *
+ * @param [in] c  The context with the prime.
+ * @param [in] r  The difference.
+ * @param [in] a  The number to subtract from.
+ * @param [in] b  The number to subtract.
+ */
+static void share_native_sub(const SHARE_NATIVE_CTX *c, SHARE_NATIVE_NUM *r,
+    const SHARE_NATIVE_NUM *a, const SHARE_NATIVE_NUM *b)
+{
+    uint64_t borrow = 0, mask;
+    share_native_dword s;
+    int i;
+
+    for (i=0; i<c->limbs; i++)
+    {
+        s = (share_native_dword)a->l[i] - b->l[i] - borrow;
+        r->l[i] = (uint64_t)s;
+        borrow = (uint64_t)(s >> 64) & 1;
+    }
+    /* Add back the prime when negative. */
+    mask = 0 - borrow;
+    s = 0;
+    for (i=0; i<c->limbs; i++)
+    {
+        s += (share_native_dword)r->l[i] + (c->p[i] & mask);
+        r->l[i] = (uint64_t)s;
+        s >>= 64;
+    }
+}
+
+/**
+ * Set a number to one.
+ *
+ * @param [in] r  The number.
+ */
+static void share_native_one(SHARE_NATIVE_NUM *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->l[0] = 1;
+}
+
+/**
+ * Check whether a number is zero.
+ *
+ * @param [in] c  The context with the prime.
+ * @param [in] a  The number.
+ * @return  1 when the number is zero.<br>
+ *          0 otherwise.
+ */
+static int share_native_is_zero(const SHARE_NATIVE_CTX *c,
+    const SHARE_NATIVE_NUM *a)
+{
+    uint64_t t = 0;
+    int i;
+
+    for (i=0; i<c->limbs; i++)
+        t |= a->l[i];
+    return t == 0;
+}
+
+/**
+ * Square a number k times modulo the prime: r = a^(2^k).
+ *
+ * @param [in] c  The context with the prime.
+ * @param [in] r  The result. May be the same as a.
+ * @param [in] a  The number to square.
+ * @param [in] k  The number of squarings.
+ */
+static void share_native_sqr_n(const SHARE_NATIVE_CTX *c,
+    SHARE_NATIVE_NUM *r, const SHARE_NATIVE_NUM *a, int k)
+{
+    *r = *a;
+    while (k-- > 0)
+        share_native_mul(c, r, r, r);
+}
+
+/**
+ * Invert a number modulo the prime: r = a^(p-2).
+ * Bits 8 and up of p-2 are all ones, so a^(2^m - 1) is calculated with an
+ * addition chain of about m squarings and 2.log2(m) multiplications, then
+ * the bottom 8 bits are multiplied in.
+ * Always the same operations for a prime. Zero has no inverse and gives
+ * zero.
+ *
+ * @param [in] c  The context with the prime.
+ * @param [in] r  The inverse. May be the same as a.
+ * @param [in] a  The number to invert.
+ */
+static void share_native_inv(const SHARE_NATIVE_CTX *c, SHARE_NATIVE_NUM *r,
+    const SHARE_NATIVE_NUM *a)
+{
+    SHARE_NATIVE_NUM b, t, u;
+    int m = 64 * (c->limbs-1) + 1 - 8;
+    int e = (int)((c->p[0] - 2) & 0xff);
+    int k = 1;
+    int i;
+
+    b = *a;
+    /* t = b^(2^k - 1), k built up from the top bit of m. */
+    t = b;
+    for (i=30; (i >= 0) && (((m >> i) & 1) == 0); i--)
+        ;
+    for (i--; i>=0; i--)
+    {
+        share_native_sqr_n(c, &u, &t, k);
+        share_native_mul(c, &t, &u, &t);
+        k *= 2;
+        if ((m >> i) & 1)
+        {
+            share_native_mul(c, &t, &t, &t);
+            share_native_mul(c, &t, &t, &b);
+            k++;
+        }
+    }
+    /* Bottom 8 bits of p-2. */
+    for (i=7; i>=0; i--)
+    {
+        share_native_mul(c, &t, &t, &t);
+        if ((e >> i) & 1)
+            share_native_mul(c, &t, &t, &b);
+    }
+    *r = t;
+
+    share_native_clear(&b, sizeof(b));
+    share_native_clear(&t, sizeof(t));
+    share_native_clear(&u, sizeof(u));
+}
+
+/**
+ * Create a new number object.
+ *
+ * @param [in]  len  The length of the secret in bytes.
+ * @param [out] num  The new number object.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_native_num_new(uint16_t len, void **num)
+{
+    SHARE_ERR err = NONE;
+
+    (void)len;
+
+    *num = calloc(1, sizeof(SHARE_NATIVE_NUM));
+    if (*num == NULL)
+        err = ALLOC;
+
+    return err;
+}
+
+/**
+ * Free the dynamic memory associated with the number object.
+ *
+ * @param [in] num  The number object.
+ */
+void share_native_num_free(void *num)
+{
+    if (num == NULL)
+        return;
+
+    share_native_clear(num, sizeof(SHARE_NATIVE_NUM));
+    free(num);
+}
+
+/**
+ * Decode the data into the number object, reduced modulo the prime unless
+ * ctx is NULL.
+ * The data is assumed to be big-endian bytes.
+ *
+ * @param [in] ctx   The context of the share operations object. May be NULL.
+ * @param [in] data  The data to be decoded.
+ * @param [in] len   The length of the data to be decoded.
+ * @param [in] num   The number object.
+ * @return  PARAM_BAD_LEN when the data is too long for a number.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_native_num_from_bin(void *ctx, const uint8_t *data,
+    uint16_t len, void *num)
+{
+    SHARE_ERR err = NONE;
+    SHARE_NATIVE_CTX *c = ctx;
+    SHARE_NATIVE_NUM *a = num;
+    int max = (c != NULL) ? c->limbs * 8 : (int)sizeof(a->l);
+    int i;
+
+    if (len > max)
+    {
+        err = PARAM_BAD_LEN;
+        goto end;
+    }
+
+    memset(a, 0, sizeof(*a));
+    for (i=0; i<len; i++)
+        a->l[i/8] |= (uint64_t)data[len-1-i] << (8 * (i%8));
+
+    /* At most 63 bits above B: two folds leave it less than twice p. */
+    if (c != NULL)
+    {
+        share_native_fold(a->l, c->limbs, c->c);
+        share_native_fold(a->l, c->limbs, c->c);
+        share_native_reduce_once(a->l, a->l, c->p, c->limbs);
+    }
+end:
+    return err;
+}
+
+/**
+ * Encode the number object into data.
+ * The data is assumed to be big-endian bytes.
+ *
+ * @param [in] ctx   The context of the share operations object. Unused.
+ * @param [in] num   The number object.
+ * @param [in] data  The data to hold the encoding.
+ * @param [in] len   The number of bytes that data can hold.
+ * @return  PARAM_BAD_LEN when encoding is too long for data.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_native_num_to_bin(void *ctx, void *num, uint8_t *data,
+    uint16_t len)
+{
+    SHARE_ERR err = NONE;
+    SHARE_NATIVE_NUM *a = num;
+    int i;
+
+    (void)ctx;
+
+    /* Bytes that don't fit must be zero. */
+    for (i=len; i<(int)sizeof(a->l); i++)
+    {
+        if (((a->l[i/8] >> (8 * (i%8))) & 0xff) != 0)
+        {
+            err = PARAM_BAD_LEN;
+            goto end;
+        }
+    }
+
+    for (i=0; i<len; i++)
+    {
+        if (i < (int)sizeof(a->l))
+            data[len-1-i] = (uint8_t)(a->l[i/8] >> (8 * (i%8)));
+        else
+            data[len-1-i] = 0;
+    }
+end:
+    return err;
+}
+
+/**
+ * Create the context holding the prime in the form the calculations use.
+ * The prime must be 2^B - c where B is one more than a multiple of 64 and
+ * c is less than 255.
+ *
+ * @param [in]  prime  The prime as a number object.
+ * @param [in]  parts  The number of parts that are required to recalcuate
+ *                     secret.
+ * @param [out] ctx    The new context.
+ * @return  PARAM_BAD_VALUE when the prime doesn't have the form supported.
+ *          <br>
+ *          ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_native_ctx_new(void *prime, uint8_t parts, void **ctx)
+{
+    SHARE_ERR err = PARAM_BAD_VALUE;
+    SHARE_NATIVE_NUM *p = prime;
+    SHARE_NATIVE_CTX *c = NULL;
+    int n, i;
+
+    (void)parts;
+
+    /* Top limb is one, the middle limbs all ones. */
+    for (n=SHARE_NATIVE_LIMBS; (n > 0) && (p->l[n-1] == 0); n--)
+        ;
+    if ((n < 3) || (p->l[n-1] != 1) || (p->l[0] < (uint64_t)0 - 0xfe))
+        goto end;
+    for (i=1; i<n-1; i++)
+    {
+        if (p->l[i] != (uint64_t)0 - 1)
+            goto end;
+    }
+
+    c = malloc(sizeof(*c));
+    if (c == NULL)
+    {
+        err = ALLOC;
+        goto end;
+    }
+    c->limbs = n;
+    c->c = (uint64_t)0 - p->l[0];
+    memcpy(c->p, p->l, sizeof(c->p));
+    c->inv = NULL;
+
+    *ctx = c;
+    err = NONE;
+end:
+    return err;
+}
+
+/**
+ * Free the context.
+ *
+ * @param [in] ctx  The context.
+ */
+void share_native_ctx_free(void *ctx)
+{
+    SHARE_NATIVE_CTX *c = ctx;
+
+    if (c != NULL)
+        free(c->inv);
+    free(c);
+}
+
+/**
+ * Calculate the y value of a split.
+ * y = x^0.a[0] + x^1.a[1] + ... + x^(parts-1).a[parts-1]
+ *
+ * @param [in] ctx    The context of the share operations object.
+ * @param [in] prime  The prime as a number object. Unused.
+ * @param [in] parts  The number of parts that are required to recalcuate
+ *                    secret.
+ * @param [in] a      The array of coefficients.
+ * @param [in] x      The x value as a number object.
+ * @param [in] y      The y value as a number object.
+ * @return  NONE.
+ */
+SHARE_ERR share_native_split(void *ctx, void *prime, uint8_t parts,
+    void **a, void *x, void *y)
+{
+    SHARE_NATIVE_CTX *c = ctx;
+    int i;
+
+    (void)prime;
+
+    /* Horner: y = (..(a[parts-1].x + a[parts-2]).x + ..).x + a[0] */
+    *(SHARE_NATIVE_NUM *)y = *(SHARE_NATIVE_NUM *)a[parts-1];
+    for (i=parts-2; i>=0; i--)
+    {
+        share_native_mul(c, y, y, x);
+        share_native_add(c, y, y, a[i]);
+    }
+
+    return NONE;
+}
+
+/**
+ * Calculate the y values of the splits at several x values.
+ * y[i] = x[i]^0.a[0] + x[i]^1.a[1] + ... + x[i]^(parts-1).a[parts-1]
+ * Horner's rule steps through the coefficients once for all the x values, so
+ * the multiplications of the x values are independent of each other.
+ *
+ * @param [in] ctx    The context of the share operations object.
+ * @param [in] prime  The prime as a number object. Unused.
+ * @param [in] parts  The number of parts that are required to recalcuate
+ *                    secret.
+ * @param [in] a      The array of coefficients.
+ * @param [in] x      The array of x values.
+ * @param [in] y      The array of y values as number objects.
+ * @param [in] n      The number of x values.
+ * @return  NONE.
+ */
+SHARE_ERR share_native_split_batch(void *ctx, void *prime, uint8_t parts,
+    void **a, const uint16_t *x, void **y, int n)
+{
+    SHARE_NATIVE_CTX *c = ctx;
+    SHARE_NATIVE_NUM **yn = (SHARE_NATIVE_NUM **)y;
+    int i, j;
+
+    (void)prime;
+
+    for (i=0; i<n; i++)
+        *yn[i] = *(SHARE_NATIVE_NUM *)a[parts-1];
+    for (j=parts-2; j>=0; j--)
+    {
+        for (i=0; i<n; i++)
+        {
+            share_native_mul_small(c, yn[i], yn[i], x[i]);
+            share_native_add(c, yn[i], yn[i], a[j]);
+        }
+    }
+
+    return NONE;
+}
+
+/**
+ * Calculate the denominators of the Lagrange terms.
+ * d[i] = x[i] * (product of all x[j] - x[i] where i != j)
+ *
+ * @param [in] c      The context of the share operations object.
+ * @param [in] parts  The number of parts.
+ * @param [in] x      The array of x values as number objects.
+ * @param [in] d      The array of denominators.
+ */
+static void share_native_denoms(const SHARE_NATIVE_CTX *c, uint8_t parts,
+    void **x, SHARE_NATIVE_NUM *d)
+{
+    SHARE_NATIVE_NUM t;
+    int i, j;
+
+    for (i=0; i<parts; i++)
+    {
+        share_native_one(&d[i]);
+        for (j=0; j<parts; j++)
+        {
+            if (i == j)
+                continue;
+
+            share_native_sub(c, &t, x[j], x[i]);
+            share_native_mul(c, &d[i], &d[i], &t);
+        }
+        share_native_mul(c, &d[i], &d[i], x[i]);
+    }
+}
+
+/**
+ * Calculate the secret from splits.
+ * secret = sum of (i=0..parts-1) y[i] *
+ *          product of (j=0..parts-1) x[j] / (x[j] - x[i]) where j != i
+ *
+ * @param [in] ctx     The context of the share operations object.
+ * @param [in] prime   The prime as a number object. Unused.
+ * @param [in] parts   The number of parts that are required to recalcuate
+ *                     secret.
+ * @param [in] x       The array of x values as number objects.
+ * @param [in] y       The array of y values as number objects.
+ * @param [in] secret  The calculated secret as a number object.
+ * @return  MOD_INV when the x values are not distinct and non-zero.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_native_join(void *ctx, void *prime, uint8_t parts, void **x,
+    void **y, void *secret)
+{
+    SHARE_ERR err;
+    SHARE_NATIVE_NUM w[SHARE_PARTS_MAX];
+    void *wp[SHARE_PARTS_MAX];
+    int i;
+
+    for (i=0; i<parts; i++)
+        wp[i] = &w[i];
+    /* The weights, then the weighted sum. */
+    err = share_native_weights(ctx, prime, parts, x, wp);
+    if (err == NONE)
+        err = share_native_combine(ctx, prime, parts, wp, y, secret);
+
+    share_native_clear(w, sizeof(w));
+    return err;
+}
+
+/**
+ * Calculate the weights of the splits.
+ * w[i] = product of (j=0..parts-1) x[j] / (x[j] - x[i]) where j != i
+ *
+ * @param [in] ctx    The context of the share operations object.
+ * @param [in] prime  The prime as a number object. Unused.
+ * @param [in] parts  The number of parts that are required to recalcuate
+ *                    secret.
+ * @param [in] x      The array of x values as number objects.
+ * @param [in] w      The array of weights as number objects.
+ * @return  MOD_INV when the x values are not distinct and non-zero.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_native_weights(void *ctx, void *prime, uint8_t parts,
+    void **x, void **w)
+{
+    SHARE_ERR err = NONE;
+    SHARE_NATIVE_CTX *c = ctx;
+    SHARE_NATIVE_NUM np, t;
+    SHARE_NATIVE_NUM d[SHARE_PARTS_MAX];
+    SHARE_NATIVE_NUM **wn = (SHARE_NATIVE_NUM **)w;
+    int i;
+
+    (void)prime;
+
+    /* np = x[0] * x[1] * .. * x[parts-1] */
+    np = *(SHARE_NATIVE_NUM *)x[0];
+    for (i=1; i<parts; i++)
+        share_native_mul(c, &np, &np, x[i]);
+
+    share_native_denoms(c, parts, x, d);
+
+    /* Batch inversion: w[i] = d[0] * .. * d[i] */
+    for (i=0; i<parts; i++)
+    {
+        if (i == 0)
+            *wn[0] = d[0];
+        else
+            share_native_mul(c, wn[i], wn[i-1], &d[i]);
+    }
+    if (share_native_is_zero(c, wn[parts-1]))
+    {
+        err = MOD_INV;
+        goto end;
+    }
+    /* t = np / (d[0] * .. * d[parts-1]) */
+    share_native_inv(c, &t, wn[parts-1]);
+    share_native_mul(c, &t, &t, &np);
+
+    /* w[i] = np / d[i] = t * d[0] * .. * d[i-1], then divide d[i] out of t.
+     */
+    for (i=parts-1; i>0; i--)
+    {
+        share_native_mul(c, wn[i], &t, wn[i-1]);
+        share_native_mul(c, &t, &t, &d[i]);
+    }
+    *wn[0] = t;
+end:
+    return err;
+}
+
+/**
+ * Calculate the secret from the weights and the y values of the splits.
+ * secret = sum of (i=0..parts-1) w[i] * y[i]
+ *
+ * @param [in] ctx     The context of the share operations object.
+ * @param [in] prime   The prime as a number object. Unused.
+ * @param [in] parts   The number of parts that are required to recalcuate
+ *                     secret.
+ * @param [in] w       The array of weights as number objects.
+ * @param [in] y       The array of y values as number objects.
+ * @param [in] secret  The calculated secret as a number object.
+ * @return  NONE.
+ */
+SHARE_ERR share_native_combine(void *ctx, void *prime, uint8_t parts,
+    void **w, void **y, void *secret)
+{
+    SHARE_NATIVE_CTX *c = ctx;
+    SHARE_NATIVE_NUM t;
+    int i;
+
+    (void)prime;
+
+    memset(secret, 0, sizeof(SHARE_NATIVE_NUM));
+    for (i=0; i<parts; i++)
+    {
+        share_native_mul(c, &t, w[i], y[i]);
+        share_native_add(c, secret, secret, &t);
+    }
+
+    share_native_clear(&t, sizeof(t));
+    return NONE;
+}
+
+/**
+ * Calculate the inverses of the small integers 1 to SHARE_SMALL_MAX with one
+ * inversion: the inverse of their product, from which each is taken out in
+ * turn.
+ *
+ * @param [in] c  The context of the share operations object.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+static SHARE_ERR share_native_inv_small(SHARE_NATIVE_CTX *c)
+{
+    SHARE_ERR err = NONE;
+    SHARE_NATIVE_NUM *inv;
+    SHARE_NATIVE_NUM t, d;
+    int i;
+
+    inv = malloc((SHARE_SMALL_MAX + 1) * sizeof(*inv));
+    if (inv == NULL)
+    {
+        err = ALLOC;
+        goto end;
+    }
+
+    /* inv[i] = 1 * 2 * .. * i */
+    share_native_one(&inv[0]);
+    share_native_one(&d);
+    for (i=1; i<=SHARE_SMALL_MAX; i++)
+    {
+        d.l[0] = i;
+        share_native_mul(c, &inv[i], &inv[i-1], &d);
+    }
+    share_native_inv(c, &t, &inv[SHARE_SMALL_MAX]);
+    /* 1 / i = t * 1 * .. * (i-1) where t = 1 / (1 * .. * i) */
+    for (i=SHARE_SMALL_MAX; i>0; i--)
+    {
+        d.l[0] = i;
+        share_native_mul(c, &inv[i], &t, &inv[i-1]);
+        share_native_mul(c, &t, &t, &d);
+    }
+    memset(&inv[0], 0, sizeof(inv[0]));
+
+    c->inv = inv;
+end:
+    return err;
+}
+
+/**
+ * Calculate the weights of the splits with small integer x values.
+ * w[i] = product of (j=0..parts-1) x[j] / (x[j] - x[i]) where j != i
+ * The inverses of x[i] and of the differences are looked up, so no number is
+ * inverted once the table is calculated.
+ *
+ * @param [in] ctx    The context of the share operations object.
+ * @param [in] prime  The prime as a number object. Unused.
+ * @param [in] parts  The number of parts that are required to recalcuate
+ *                    secret.
+ * @param [in] x      The array of x values, 1 to SHARE_SMALL_MAX.
+ * @param [in] w      The array of weights as number objects.
+ * @return  PARAM_BAD_VALUE when an x value is greater than SHARE_SMALL_MAX.
+ *          <br>
+ *          ALLOC when dynamic memory allocation fails.<br>
+ *          MOD_INV when the x values are not distinct and non-zero.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_native_weights_small(void *ctx, void *prime, uint8_t parts,
+    const uint16_t *x, void **w)
+{
+    SHARE_ERR err = NONE;
+    SHARE_NATIVE_CTX *c = ctx;
+    SHARE_NATIVE_NUM np, t;
+    SHARE_NATIVE_NUM **wn = (SHARE_NATIVE_NUM **)w;
+    int i, j, neg;
+
+    (void)prime;
+
+    for (i=0; i<parts; i++)
+    {
+        if (x[i] > SHARE_SMALL_MAX)
+        {
+            err = PARAM_BAD_VALUE;
+            goto end;
+        }
+        for (j=0; j<i; j++)
+        {
+            if (x[j] == x[i])
+                break;
+        }
+        if ((x[i] == 0) || (j < i))
+        {
+            err = MOD_INV;
+            goto end;
+        }
+    }
+    if (c->inv == NULL)
+    {
+        err = share_native_inv_small(c);
+        if (err != NONE) goto end;
+    }
+
+    /* np = x[0] * x[1] * .. * x[parts-1] */
+    share_native_one(&np);
+    share_native_one(&t);
+    for (i=0; i<parts; i++)
+    {
+        t.l[0] = x[i];
+        share_native_mul(c, &np, &np, &t);
+    }
+
+    /* w[i] = np / x[i] / product of (x[j] - x[i]) where j != i */
+    memset(&t, 0, sizeof(t));
+    for (i=0; i<parts; i++)
+    {
+        share_native_mul(c, wn[i], &np, &c->inv[x[i]]);
+        neg = 0;
+        for (j=0; j<parts; j++)
+        {
+            if (j == i)
+                continue;
+
+            if (x[j] > x[i])
+                share_native_mul(c, wn[i], wn[i], &c->inv[x[j]-x[i]]);
+            else
+            {
+                share_native_mul(c, wn[i], wn[i], &c->inv[x[i]-x[j]]);
+                neg ^= 1;
+            }
+        }
+        if (neg)
+            share_native_sub(c, wn[i], &t, wn[i]);
+    }
+end:
+    return err;
+}
+
+#endif /* SHARE_NATIVE */
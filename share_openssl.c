@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 #include "share_meth.h"
 #include "openssl/bn.h"
@@ -45,24 +46,29 @@ SHARE_ERR share_openssl_num_new(uint16_t len, void **num)
  */
 void share_openssl_num_free(void *num)
 {
-    BN_free(num);
+    BN_clear_free(num);
 }
 
 /**
  * Decode the data into the number object.
  * The data is assumed to be big-endian bytes.
  *
+ * @param [in] ctx   The context of the share operations object. Unused.
  * @param [in] data  The data to be decoded.
  * @param [in] len   The length of the data to be decoded.
  * @param [in] num   The number object.
  * @return  ALLOC when dynamic memory allocation fails.<br>
  *          NONE otherwise.
  */
-SHARE_ERR share_openssl_num_from_bin(const uint8_t *data, uint16_t len,
-    void *num)
+SHARE_ERR share_openssl_num_from_bin(void *ctx, const uint8_t *data,
+    uint16_t len, void *num)
 {
     SHARE_ERR err = NONE;
 
+    (void)ctx;
+
+    /* Wipe the old value, BN_bin2bn keeps the words above the new one. */
+    BN_clear(num);
     if (BN_bin2bn(data, len, num) == NULL)
         err = ALLOC;
 
@@ -73,26 +79,141 @@ SHARE_ERR share_openssl_num_from_bin(const uint8_t *data, uint16_t len,
  * Encode the number object into data.
  * The data is assumed to be big-endian bytes.
  *
+ * @param [in] ctx   The context of the share operations object. Unused.
  * @param [in] num   The number object.
  * @param [in] data  The data to hold the encoding.
  * @param [in] len   The number of bytes that data can hold.
  * @return  PARAM_BAD_LEN when encoding is too long for data.<br>
  *          NONE otherwise.
  */
-SHARE_ERR share_openssl_num_to_bin(void *num, uint8_t *data, uint16_t len)
+SHARE_ERR share_openssl_num_to_bin(void *ctx, void *num, uint8_t *data,
+    uint16_t len)
 {
     SHARE_ERR err = NONE;
 
+    (void)ctx;
+
     if (BN_bn2binpad(num, data, len) == -1)
         err = PARAM_BAD_LEN;
 
     return err;
 }
 
+/** The temporaries of the calculations of a share operations object. */
+typedef struct share_openssl_ctx_st
+{
+    /** The big number context. */
+    BN_CTX *bn;
+    /** The number of parts the arrays are allocated for. */
+    uint8_t parts;
+    /** The product of the x values. */
+    BIGNUM *np;
+    /** Scratch numbers. */
+    BIGNUM *t;
+    BIGNUM *m;
+    /** The numerators of the Lagrange terms. */
+    BIGNUM **n;
+    /** The denominators of the Lagrange terms. */
+    BIGNUM **d;
+    /** The Montgomery form of the prime. Montgomery method only. */
+    BN_MONT_CTX *mont;
+    /** One in Montgomery form. Montgomery method only. */
+    BIGNUM *one;
+    /** Scratch number for encoding. Montgomery method only. */
+    BIGNUM *e;
+} SHARE_OPENSSL_CTX;
+
+/**
+ * Create the context holding the temporaries of the calculations.
+ *
+ * @param [in]  prime  The prime as a number object.
+ * @param [in]  parts  The number of parts that are required to recalcuate
+ *                     secret.
+ * @param [out] ctx    The new context.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_openssl_ctx_new(void *prime, uint8_t parts, void **ctx)
+{
+    SHARE_ERR err = ALLOC;
+    SHARE_OPENSSL_CTX *c;
+    int i;
+
+    (void)prime;
+
+    c = malloc(sizeof(*c));
+    if (c == NULL)
+        goto end;
+    memset(c, 0, sizeof(*c));
+    c->parts = parts;
+
+    c->bn = BN_CTX_new();
+    c->np = BN_new();
+    c->t = BN_new();
+    c->m = BN_new();
+    c->n = malloc(parts * sizeof(*c->n));
+    c->d = malloc(parts * sizeof(*c->d));
+    if ((c->bn == NULL) || (c->np == NULL) || (c->t == NULL) ||
+        (c->m == NULL) || (c->n == NULL) || (c->d == NULL))
+        goto end;
+    memset(c->n, 0, parts * sizeof(*c->n));
+    memset(c->d, 0, parts * sizeof(*c->d));
+    for (i=0; i<parts; i++)
+    {
+        c->n[i] = BN_new();
+        c->d[i] = BN_new();
+        if ((c->n[i] == NULL) || (c->d[i] == NULL))
+            goto end;
+    }
+
+    *ctx = c;
+    c = NULL;
+    err = NONE;
+end:
+    share_openssl_ctx_free(c);
+    return err;
+}
+
+/**
+ * Free the context, clearing the temporaries.
+ *
+ * @param [in] ctx  The context.
+ */
+void share_openssl_ctx_free(void *ctx)
+{
+    SHARE_OPENSSL_CTX *c = ctx;
+    int i;
+
+    if (c == NULL)
+        return;
+
+    if (c->d != NULL)
+    {
+        for (i=c->parts-1; i>=0; i--)
+            BN_clear_free(c->d[i]);
+        free(c->d);
+    }
+    if (c->n != NULL)
+    {
+        for (i=c->parts-1; i>=0; i--)
+            BN_clear_free(c->n[i]);
+        free(c->n);
+    }
+    BN_clear_free(c->e);
+    BN_free(c->one);
+    BN_MONT_CTX_free(c->mont);
+    BN_clear_free(c->m);
+    BN_clear_free(c->t);
+    BN_clear_free(c->np);
+    BN_CTX_free(c->bn);
+    free(c);
+}
+
 /**
  * Calculate the y value of a split.
  * y = x^0.a[0] + x^1.a[1] + ... + x^(parts-1).a[parts-1]
  *
+ * @param [in] ctx    The context of the share operations object.
  * @param [in] prime  The prime as a number object.
  * @param [in] parts  The number of parts that are required to recalcuate
  *                    secret.
@@ -102,23 +223,17 @@ SHARE_ERR share_openssl_num_to_bin(void *num, uint8_t *data, uint16_t len)
  * @return  ALLOC when dynamic memory allocation fails.<br>
  *          NONE otherwise.
  */
-SHARE_ERR share_openssl_split(void *prime, uint8_t parts, void **a, void *x,
-    void *y)
+SHARE_ERR share_openssl_split(void *ctx, void *prime, uint8_t parts, void **a,
+    void *x, void *y)
 {
     SHARE_ERR err = ALLOC;
+    SHARE_OPENSSL_CTX *c = ctx;
     int ret = 1;
     int i;
-    BN_CTX *ctx;
-    BIGNUM *t, *m;
-
-    ctx = BN_CTX_new();
-    t = BN_new();
-    m = BN_new();
-    if ((ctx == NULL) || (t == NULL) || (m == NULL))
-        goto end;
+    BIGNUM *t = c->t, *m = c->m;
 
     /* y = x^0.a[0] + x^1.a[1] - minimum of two parts. */
-    ret &= BN_mod_mul(t, a[1], x, prime, ctx);
+    ret &= BN_mod_mul(t, a[1], x, prime, c->bn);
     ret &= BN_add(y, a[0], t);
     if (BN_cmp(y, prime) >= 0)
         ret &= BN_sub(y, y, prime);
@@ -127,8 +242,8 @@ SHARE_ERR share_openssl_split(void *prime, uint8_t parts, void **a, void *x,
     for (i=2; i<parts; i++)
     {
         /* y += x^i.a[i] (m = x^i) */
-        ret &= BN_mod_mul(m, m, x, prime, ctx);
-        ret &= BN_mod_mul(t, a[i], m, prime, ctx);
+        ret &= BN_mod_mul(m, m, x, prime, c->bn);
+        ret &= BN_mod_mul(t, a[i], m, prime, c->bn);
         ret &= BN_add(y, y, t);
         if (BN_cmp(y, prime) >= 0)
             ret &= BN_sub(y, y, prime);
@@ -137,10 +252,6 @@ SHARE_ERR share_openssl_split(void *prime, uint8_t parts, void **a, void *x,
     /* No error if all operations succeeded. */
     if (ret == 1)
         err = NONE;
-end:
-    BN_free(m);
-    BN_free(t);
-    BN_CTX_free(ctx);
     return err;
 }
 
@@ -149,6 +260,7 @@ end:
  * secret = sum of (i=0..parts-1) y[i] *
  *          product of (j=0..parts-1) x[j] / (x[j] - x[i]) where j != i
  *
+ * @param [in] ctx     The context of the share operations object.
  * @param [in] prime   The prime as a number object.
  * @param [in] parts   The number of parts that are required to recalcuate
  *                     secret.
@@ -156,46 +268,56 @@ end:
  * @param [in] y       The array of y values as number objects.
  * @param [in] secret  The calculated secret as a number object.
  * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          MOD_INV when the x values are not distinct and non-zero.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_openssl_join(void *ctx, void *prime, uint8_t parts, void **x,
+    void **y, void *secret)
+{
+    SHARE_ERR err;
+    SHARE_OPENSSL_CTX *c = ctx;
+
+    /* Weights into the numerator temporaries, then the weighted sum. */
+    err = share_openssl_weights(ctx, prime, parts, x, (void **)c->n);
+    if (err == NONE)
+        err = share_openssl_combine(ctx, prime, parts, (void **)c->n, y,
+            secret);
+
+    return err;
+}
+
+/**
+ * Calculate the weights of the splits.
+ * w[i] = product of (j=0..parts-1) x[j] / (x[j] - x[i]) where j != i
+ *
+ * @param [in] ctx    The context of the share operations object.
+ * @param [in] prime  The prime as a number object.
+ * @param [in] parts  The number of parts that are required to recalcuate
+ *                    secret.
+ * @param [in] x      The array of x values as number objects.
+ * @param [in] w      The array of weights as number objects.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          MOD_INV when the x values are not distinct and non-zero.<br>
  *          NONE otherwise.
  */
-SHARE_ERR share_openssl_join(void *prime, uint8_t parts, void **x, void **y,
-    void *secret)
+SHARE_ERR share_openssl_weights(void *ctx, void *prime, uint8_t parts,
+    void **x, void **w)
 {
     SHARE_ERR err = ALLOC;
+    SHARE_OPENSSL_CTX *c = ctx;
     int ret = 1;
     int i, j;
-    BN_CTX *ctx;
-    BIGNUM *np, *t;
-    BIGNUM **n = NULL, **d = NULL;
-
-    ctx = BN_CTX_new();
-    np = BN_new();
-    t = BN_new();
-    if ((ctx == NULL) || (np == NULL) || (t == NULL))
-        goto end;
-
-    /* Arrays of numerators and denominators as number objects. */
-    n = malloc(parts * sizeof(*n));
-    d = malloc(parts * sizeof(*d));
-    if ((n == NULL) || (d == NULL))
-        goto end;
-    for (i=0; i<parts; i++)
-    {
-        n[i] = BN_new();
-        d[i] = BN_new();
-        if ((n[i] == NULL) || (d[i] == NULL))
-            goto end;
-    }
+    BIGNUM *np = c->np, *t = c->t;
+    BIGNUM **d = c->d;
 
     /* np = x[0] * x[1] * .. * x[parts-1] */
     ret &= (BN_copy(np, x[0]) != NULL);
     for (i=1; i<parts; i++)
-        ret &= BN_mod_mul(np, np, x[i], prime, ctx);
+        ret &= BN_mod_mul(np, np, x[i], prime, c->bn);
 
-    /* Calculate all the denominators. */
+    /* d[i] = x[i] * (product of all x[j] - x[i] where i != j). */
     for (i=0; i<parts; i++)
     {
-        /* d[i] = x[i] * (product of all x[j] - x[i] where i != j). */
         ret &= BN_set_word(d[i], 1);
         for (j=0; j<parts; j++)
         {
@@ -203,61 +325,414 @@ SHARE_ERR share_openssl_join(void *prime, uint8_t parts, void **x, void **y,
                 continue;
 
             ret &= BN_sub(t, x[j], x[i]);
-            ret &= BN_mod_mul(d[i], d[i], t, prime, ctx);
+            ret &= BN_mod_mul(d[i], d[i], t, prime, c->bn);
         }
         /* Ensure positive for inversion. */
         if (BN_is_negative(d[i]))
             ret &= BN_add(d[i], d[i], prime);
-        ret &= BN_mod_mul(d[i], d[i], x[i], prime, ctx);
+        ret &= BN_mod_mul(d[i], d[i], x[i], prime, c->bn);
+    }
+
+    /* Batch inversion: w[i] = d[0] * .. * d[i] */
+    ret &= BN_copy(w[0], d[0]) != NULL;
+    for (i=1; i<parts; i++)
+        ret &= BN_mod_mul(w[i], w[i-1], d[i], prime, c->bn);
+    if (ret != 1)
+        goto end;
+    /* t = np / (d[0] * .. * d[parts-1]) */
+    if (BN_mod_inverse(t, w[parts-1], prime, c->bn) == NULL)
+    {
+        err = MOD_INV;
+        goto end;
+    }
+    ret &= BN_mod_mul(t, t, np, prime, c->bn);
+
+    /* w[i] = np / d[i] = t * d[0] * .. * d[i-1], then divide d[i] out of t.
+     */
+    for (i=parts-1; i>0; i--)
+    {
+        ret &= BN_mod_mul(w[i], t, w[i-1], prime, c->bn);
+        ret &= BN_mod_mul(t, t, d[i], prime, c->bn);
+    }
+    ret &= BN_copy(w[0], t) != NULL;
+
+    /* No error if all operations succeeded. */
+    if (ret == 1)
+        err = NONE;
+end:
+    return err;
+}
+
+/**
+ * Calculate the secret from the weights and the y values of the splits.
+ * secret = sum of (i=0..parts-1) w[i] * y[i]
+ *
+ * @param [in] ctx     The context of the share operations object.
+ * @param [in] prime   The prime as a number object.
+ * @param [in] parts   The number of parts that are required to recalcuate
+ *                     secret.
+ * @param [in] w       The array of weights as number objects.
+ * @param [in] y       The array of y values as number objects.
+ * @param [in] secret  The calculated secret as a number object.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_openssl_combine(void *ctx, void *prime, uint8_t parts,
+    void **w, void **y, void *secret)
+{
+    SHARE_ERR err = ALLOC;
+    SHARE_OPENSSL_CTX *c = ctx;
+    int ret = 1;
+    int i;
+    BIGNUM *t = c->t;
+
+    BN_zero(secret);
+    for (i=0; i<parts; i++)
+    {
+        ret &= BN_mod_mul(t, w[i], y[i], prime, c->bn);
+        ret &= BN_add(secret, secret, t);
+        if (BN_cmp(secret, prime) >= 0)
+            ret &= BN_sub(secret, secret, prime);
+    }
+
+    /* No error if all operations succeeded. */
+    if (ret == 1)
+        err = NONE;
+    return err;
+}
+
+/**
+ * Create the context of the Montgomery method: the generic temporaries and
+ * the Montgomery form of the prime, computed once for the object.
+ *
+ * @param [in]  prime  The prime as a number object.
+ * @param [in]  parts  The number of parts that are required to recalcuate
+ *                     secret.
+ * @param [out] ctx    The new context.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_openssl_mont_ctx_new(void *prime, uint8_t parts, void **ctx)
+{
+    SHARE_ERR err;
+    SHARE_OPENSSL_CTX *c = NULL;
+
+    err = share_openssl_ctx_new(prime, parts, (void **)&c);
+    if (err != NONE) goto end;
+
+    err = ALLOC;
+    c->mont = BN_MONT_CTX_new();
+    c->one = BN_new();
+    c->e = BN_new();
+    if ((c->mont == NULL) || (c->one == NULL) || (c->e == NULL))
+        goto end;
+    if (BN_MONT_CTX_set(c->mont, prime, c->bn) != 1)
+        goto end;
+    if ((BN_one(c->one) != 1) ||
+        (BN_to_montgomery(c->one, c->one, c->mont, c->bn) != 1))
+        goto end;
+
+    *ctx = c;
+    c = NULL;
+    err = NONE;
+end:
+    share_openssl_ctx_free(c);
+    return err;
+}
+
+/**
+ * Decode the data into the number object, in Montgomery form unless ctx is
+ * NULL.
+ * The data is assumed to be big-endian bytes.
+ *
+ * @param [in] ctx   The context of the share operations object. May be NULL.
+ * @param [in] data  The data to be decoded.
+ * @param [in] len   The length of the data to be decoded.
+ * @param [in] num   The number object.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_openssl_mont_num_from_bin(void *ctx, const uint8_t *data,
+    uint16_t len, void *num)
+{
+    SHARE_ERR err = NONE;
+    SHARE_OPENSSL_CTX *c = ctx;
+
+    BN_clear(num);
+    if (BN_bin2bn(data, len, num) == NULL)
+        err = ALLOC;
+    else if ((c != NULL) &&
+             (BN_to_montgomery(num, num, c->mont, c->bn) != 1))
+        err = ALLOC;
+
+    return err;
+}
+
+/**
+ * Encode the number object, in Montgomery form unless ctx is NULL, into
+ * data.
+ * The data is assumed to be big-endian bytes.
+ *
+ * @param [in] ctx   The context of the share operations object. May be NULL.
+ * @param [in] num   The number object.
+ * @param [in] data  The data to hold the encoding.
+ * @param [in] len   The number of bytes that data can hold.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          PARAM_BAD_LEN when encoding is too long for data.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_openssl_mont_num_to_bin(void *ctx, void *num, uint8_t *data,
+    uint16_t len)
+{
+    SHARE_ERR err = NONE;
+    SHARE_OPENSSL_CTX *c = ctx;
+
+    if (c != NULL)
+    {
+        if (BN_from_montgomery(c->e, num, c->mont, c->bn) != 1)
+        {
+            err = ALLOC;
+            goto end;
+        }
+        num = c->e;
+    }
+    if (BN_bn2binpad(num, data, len) == -1)
+        err = PARAM_BAD_LEN;
+end:
+    return err;
+}
+
+/**
+ * Calculate the y value of a split with Montgomery multiplication.
+ * y = x^0.a[0] + x^1.a[1] + ... + x^(parts-1).a[parts-1]
+ * The coefficients, x and y are in Montgomery form.
+ *
+ * @param [in] ctx    The context of the share operations object.
+ * @param [in] prime  The prime as a number object.
+ * @param [in] parts  The number of parts that are required to recalcuate
+ *                    secret.
+ * @param [in] a      The array of coefficients.
+ * @param [in] x      The x value as a number object.
+ * @param [in] y      The y value as a number object.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_openssl_mont_split(void *ctx, void *prime, uint8_t parts,
+    void **a, void *x, void *y)
+{
+    SHARE_ERR err = ALLOC;
+    SHARE_OPENSSL_CTX *c = ctx;
+    int ret = 1;
+    int i;
 
-        /* n[i] = y[i].np (as x[i] is multiplied into denominator) */
-        ret &= BN_mod_mul(n[i], np, y[i], prime, ctx);
+    /* Horner: y = (..(a[parts-1].x + a[parts-2]).x + ..).x + a[0] */
+    ret &= (BN_copy(y, a[parts-1]) != NULL);
+    for (i=parts-2; i>=0; i--)
+    {
+        ret &= BN_mod_mul_montgomery(y, y, x, c->mont, c->bn);
+        ret &= BN_add(y, y, a[i]);
+        if (BN_cmp(y, prime) >= 0)
+            ret &= BN_sub(y, y, prime);
     }
 
-    /* Convert numerators to common denominator and sum. */
+    /* No error if all operations succeeded. */
+    if (ret == 1)
+        err = NONE;
+    return err;
+}
+
+/**
+ * Calculate the denominators of the Lagrange terms in Montgomery form.
+ * d[i] = x[i] * (product of all x[j] - x[i] where i != j)
+ *
+ * @param [in] c      The context of the share operations object.
+ * @param [in] prime  The prime as a number object.
+ * @param [in] parts  The number of parts.
+ * @param [in] x      The array of x values as number objects.
+ * @return  1 when all operations succeeded.<br>
+ *          0 otherwise.
+ */
+static int share_openssl_mont_denoms(SHARE_OPENSSL_CTX *c, void *prime,
+    uint8_t parts, void **x)
+{
+    int ret = 1;
+    int i, j;
+    BIGNUM *t = c->t;
+    BIGNUM **d = c->d;
+
     for (i=0; i<parts; i++)
     {
+        ret &= (BN_copy(d[i], c->one) != NULL);
         for (j=0; j<parts; j++)
         {
             if (i == j)
                 continue;
-            ret &= BN_mod_mul(n[i], n[i], d[j], prime, ctx);
-        }
-        if (i > 0)
-        {
-            ret &= BN_add(n[0], n[0], n[i]);
-            if (BN_cmp(n[0], prime) >= 0)
-                ret &= BN_sub(n[0], n[0], prime);
+
+            /* Montgomery multiplication needs operands less than prime. */
+            ret &= BN_sub(t, x[j], x[i]);
+            if (BN_is_negative(t))
+                ret &= BN_add(t, t, prime);
+            ret &= BN_mod_mul_montgomery(d[i], d[i], t, c->mont, c->bn);
         }
+        ret &= BN_mod_mul_montgomery(d[i], d[i], x[i], c->mont, c->bn);
     }
-    /* Common denominator is product of all denominators. */
+
+    return ret;
+}
+
+/**
+ * Invert the number in Montgomery form, leaving the result in Montgomery
+ * form.
+ *
+ * @param [in] c      The context of the share operations object.
+ * @param [in] prime  The prime as a number object.
+ * @param [in] r      The inverse as a number object.
+ * @param [in] a      The number object to invert.
+ * @return  1 when the number has an inverse.<br>
+ *          0 otherwise.
+ */
+static int share_openssl_mont_inverse(SHARE_OPENSSL_CTX *c, void *prime,
+    BIGNUM *r, BIGNUM *a)
+{
+    int ret = 1;
+
+    ret &= BN_from_montgomery(r, a, c->mont, c->bn);
+    ret &= (ret == 1) && (BN_mod_inverse(r, r, prime, c->bn) != NULL);
+    ret &= (ret == 1) && BN_to_montgomery(r, r, c->mont, c->bn);
+
+    return ret;
+}
+
+/**
+ * Calculate the secret from splits with Montgomery multiplication.
+ * secret = sum of (i=0..parts-1) y[i] *
+ *          product of (j=0..parts-1) x[j] / (x[j] - x[i]) where j != i
+ * The x, y and secret values are in Montgomery form.
+ *
+ * @param [in] ctx     The context of the share operations object.
+ * @param [in] prime   The prime as a number object.
+ * @param [in] parts   The number of parts that are required to recalcuate
+ *                     secret.
+ * @param [in] x       The array of x values as number objects.
+ * @param [in] y       The array of y values as number objects.
+ * @param [in] secret  The calculated secret as a number object.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          MOD_INV when the x values are not distinct and non-zero.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_openssl_mont_join(void *ctx, void *prime, uint8_t parts,
+    void **x, void **y, void *secret)
+{
+    SHARE_ERR err;
+    SHARE_OPENSSL_CTX *c = ctx;
+
+    /* Weights into the numerator temporaries, then the weighted sum. */
+    err = share_openssl_mont_weights(ctx, prime, parts, x, (void **)c->n);
+    if (err == NONE)
+        err = share_openssl_mont_combine(ctx, prime, parts, (void **)c->n, y,
+            secret);
+
+    return err;
+}
+
+/**
+ * Calculate the weights of the splits with Montgomery multiplication.
+ * w[i] = product of (j=0..parts-1) x[j] / (x[j] - x[i]) where j != i
+ * The x values and weights are in Montgomery form.
+ *
+ * @param [in] ctx    The context of the share operations object.
+ * @param [in] prime  The prime as a number object.
+ * @param [in] parts  The number of parts that are required to recalcuate
+ *                    secret.
+ * @param [in] x      The array of x values as number objects.
+ * @param [in] w      The array of weights as number objects.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          MOD_INV when the x values are not distinct and non-zero.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_openssl_mont_weights(void *ctx, void *prime, uint8_t parts,
+    void **x, void **w)
+{
+    SHARE_ERR err = ALLOC;
+    SHARE_OPENSSL_CTX *c = ctx;
+    int ret = 1;
+    int i;
+    BIGNUM *np = c->np, *t = c->t;
+    BIGNUM **d = c->d;
+
+    /* np = x[0] * x[1] * .. * x[parts-1] */
+    ret &= (BN_copy(np, x[0]) != NULL);
     for (i=1; i<parts; i++)
-        ret &= BN_mod_mul(d[0], d[0], d[i], prime, ctx);
+        ret &= BN_mod_mul_montgomery(np, np, x[i], c->mont, c->bn);
 
-    /* secret = inverse denominator * sum of numerators. */
-    ret &= (BN_mod_inverse(t, d[0], prime, ctx) != NULL);
-    ret &= BN_mod_mul(secret, t, n[0], prime, ctx);
+    ret &= share_openssl_mont_denoms(c, prime, parts, x);
 
-    /* No error if all operations succeeded. */
-    if (ret == 1)
-        err = NONE;
-end:
-    if (d != NULL)
+    /* Batch inversion: w[i] = d[0] * .. * d[i] */
+    ret &= BN_copy(w[0], d[0]) != NULL;
+    for (i=1; i<parts; i++)
+        ret &= BN_mod_mul_montgomery(w[i], w[i-1], d[i], c->mont, c->bn);
+    if (ret != 1)
+        goto end;
+    /* t = np / (d[0] * .. * d[parts-1]) */
+    if (!share_openssl_mont_inverse(c, prime, t, w[parts-1]))
     {
-        for (i=parts-1; i>=0; i--)
-            BN_free(d[i]);
-        free(d);
+        err = MOD_INV;
+        goto end;
     }
-    if (n != NULL)
+    ret &= BN_mod_mul_montgomery(t, t, np, c->mont, c->bn);
+
+    /* w[i] = np / d[i] = t * d[0] * .. * d[i-1], then divide d[i] out of t.
+     */
+    for (i=parts-1; i>0; i--)
     {
-        for (i=parts-1; i>=0; i--)
-            BN_free(n[i]);
-        free(n);
+        ret &= BN_mod_mul_montgomery(w[i], t, w[i-1], c->mont, c->bn);
+        ret &= BN_mod_mul_montgomery(t, t, d[i], c->mont, c->bn);
     }
-    BN_free(t);
-    BN_free(np);
-    BN_CTX_free(ctx);
+    ret &= BN_copy(w[0], t) != NULL;
+
+    /* No error if all operations succeeded. */
+    if (ret == 1)
+        err = NONE;
+end:
     return err;
 }
 
+/**
+ * Calculate the secret from the weights and the y values of the splits with
+ * Montgomery multiplication.
+ * secret = sum of (i=0..parts-1) w[i] * y[i]
+ * The weights, y and secret values are in Montgomery form.
+ *
+ * @param [in] ctx     The context of the share operations object.
+ * @param [in] prime   The prime as a number object.
+ * @param [in] parts   The number of parts that are required to recalcuate
+ *                     secret.
+ * @param [in] w       The array of weights as number objects.
+ * @param [in] y       The array of y values as number objects.
+ * @param [in] secret  The calculated secret as a number object.
+ * @return  ALLOC when dynamic memory allocation fails.<br>
+ *          NONE otherwise.
+ */
+SHARE_ERR share_openssl_mont_combine(void *ctx, void *prime, uint8_t parts,
+    void **w, void **y, void *secret)
+{
+    SHARE_ERR err = ALLOC;
+    SHARE_OPENSSL_CTX *c = ctx;
+    int ret = 1;
+    int i;
+    BIGNUM *t = c->t;
 
+    BN_zero(secret);
+    for (i=0; i<parts; i++)
+    {
+        ret &= BN_mod_mul_montgomery(t, w[i], y[i], c->mont, c->bn);
+        ret &= BN_add(secret, secret, t);
+        if (BN_cmp(secret, prime) >= 0)
+            ret &= BN_sub(secret, secret, prime);
+    }
+
+    /* No error if all operations succeeded. */
+    if (ret == 1)
+        err = NONE;
+    return err;
+}
@@ -4,344 +4,1837 @@
 
 #include <stdint.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
 
 #if LUA_VERSION_NUM > 501
 #define lua_objlen lua_rawlen
 #endif
 
-#if !defined(USE_OPENSSL)
-
 #define IRREDUCTIBLE_POLY 0x011b
 
-static uint8_t **MULTIPLICATIVE_INVERSE_TABLE = NULL;
+// The tables below are generated for IRREDUCTIBLE_POLY from the generator 0x03
+// of the field. They are never written, so they live in read-only memory
+// shared by every process that maps the module.
+
+// log_3(a) for a = 1..255; log of 0 is undefined and left as 0
+static const uint8_t LOGARITHM_TABLE[256] = {
+  0x00, 0x00, 0x19, 0x01, 0x32, 0x02, 0x1a, 0xc6, 0x4b, 0xc7, 0x1b, 0x68,
+  0x33, 0xee, 0xdf, 0x03, 0x64, 0x04, 0xe0, 0x0e, 0x34, 0x8d, 0x81, 0xef,
+  0x4c, 0x71, 0x08, 0xc8, 0xf8, 0x69, 0x1c, 0xc1, 0x7d, 0xc2, 0x1d, 0xb5,
+  0xf9, 0xb9, 0x27, 0x6a, 0x4d, 0xe4, 0xa6, 0x72, 0x9a, 0xc9, 0x09, 0x78,
+  0x65, 0x2f, 0x8a, 0x05, 0x21, 0x0f, 0xe1, 0x24, 0x12, 0xf0, 0x82, 0x45,
+  0x35, 0x93, 0xda, 0x8e, 0x96, 0x8f, 0xdb, 0xbd, 0x36, 0xd0, 0xce, 0x94,
+  0x13, 0x5c, 0xd2, 0xf1, 0x40, 0x46, 0x83, 0x38, 0x66, 0xdd, 0xfd, 0x30,
+  0xbf, 0x06, 0x8b, 0x62, 0xb3, 0x25, 0xe2, 0x98, 0x22, 0x88, 0x91, 0x10,
+  0x7e, 0x6e, 0x48, 0xc3, 0xa3, 0xb6, 0x1e, 0x42, 0x3a, 0x6b, 0x28, 0x54,
+  0xfa, 0x85, 0x3d, 0xba, 0x2b, 0x79, 0x0a, 0x15, 0x9b, 0x9f, 0x5e, 0xca,
+  0x4e, 0xd4, 0xac, 0xe5, 0xf3, 0x73, 0xa7, 0x57, 0xaf, 0x58, 0xa8, 0x50,
+  0xf4, 0xea, 0xd6, 0x74, 0x4f, 0xae, 0xe9, 0xd5, 0xe7, 0xe6, 0xad, 0xe8,
+  0x2c, 0xd7, 0x75, 0x7a, 0xeb, 0x16, 0x0b, 0xf5, 0x59, 0xcb, 0x5f, 0xb0,
+  0x9c, 0xa9, 0x51, 0xa0, 0x7f, 0x0c, 0xf6, 0x6f, 0x17, 0xc4, 0x49, 0xec,
+  0xd8, 0x43, 0x1f, 0x2d, 0xa4, 0x76, 0x7b, 0xb7, 0xcc, 0xbb, 0x3e, 0x5a,
+  0xfb, 0x60, 0xb1, 0x86, 0x3b, 0x52, 0xa1, 0x6c, 0xaa, 0x55, 0x29, 0x9d,
+  0x97, 0xb2, 0x87, 0x90, 0x61, 0xbe, 0xdc, 0xfc, 0xbc, 0x95, 0xcf, 0xcd,
+  0x37, 0x3f, 0x5b, 0xd1, 0x53, 0x39, 0x84, 0x3c, 0x41, 0xa2, 0x6d, 0x47,
+  0x14, 0x2a, 0x9e, 0x5d, 0x56, 0xf2, 0xd3, 0xab, 0x44, 0x11, 0x92, 0xd9,
+  0x23, 0x20, 0x2e, 0x89, 0xb4, 0x7c, 0xb8, 0x26, 0x77, 0x99, 0xe3, 0xa5,
+  0x67, 0x4a, 0xed, 0xde, 0xc5, 0x31, 0xfe, 0x18, 0x0d, 0x63, 0x8c, 0x80,
+  0xc0, 0xf7, 0x70, 0x07,
+};
+
+// 3 ^ i for i = 0..509, doubled so that log(a) + log(b) needs no reduction
+static const uint8_t EXPONENT_TABLE[512] = {
+  0x01, 0x03, 0x05, 0x0f, 0x11, 0x33, 0x55, 0xff, 0x1a, 0x2e, 0x72, 0x96,
+  0xa1, 0xf8, 0x13, 0x35, 0x5f, 0xe1, 0x38, 0x48, 0xd8, 0x73, 0x95, 0xa4,
+  0xf7, 0x02, 0x06, 0x0a, 0x1e, 0x22, 0x66, 0xaa, 0xe5, 0x34, 0x5c, 0xe4,
+  0x37, 0x59, 0xeb, 0x26, 0x6a, 0xbe, 0xd9, 0x70, 0x90, 0xab, 0xe6, 0x31,
+  0x53, 0xf5, 0x04, 0x0c, 0x14, 0x3c, 0x44, 0xcc, 0x4f, 0xd1, 0x68, 0xb8,
+  0xd3, 0x6e, 0xb2, 0xcd, 0x4c, 0xd4, 0x67, 0xa9, 0xe0, 0x3b, 0x4d, 0xd7,
+  0x62, 0xa6, 0xf1, 0x08, 0x18, 0x28, 0x78, 0x88, 0x83, 0x9e, 0xb9, 0xd0,
+  0x6b, 0xbd, 0xdc, 0x7f, 0x81, 0x98, 0xb3, 0xce, 0x49, 0xdb, 0x76, 0x9a,
+  0xb5, 0xc4, 0x57, 0xf9, 0x10, 0x30, 0x50, 0xf0, 0x0b, 0x1d, 0x27, 0x69,
+  0xbb, 0xd6, 0x61, 0xa3, 0xfe, 0x19, 0x2b, 0x7d, 0x87, 0x92, 0xad, 0xec,
+  0x2f, 0x71, 0x93, 0xae, 0xe9, 0x20, 0x60, 0xa0, 0xfb, 0x16, 0x3a, 0x4e,
+  0xd2, 0x6d, 0xb7, 0xc2, 0x5d, 0xe7, 0x32, 0x56, 0xfa, 0x15, 0x3f, 0x41,
+  0xc3, 0x5e, 0xe2, 0x3d, 0x47, 0xc9, 0x40, 0xc0, 0x5b, 0xed, 0x2c, 0x74,
+  0x9c, 0xbf, 0xda, 0x75, 0x9f, 0xba, 0xd5, 0x64, 0xac, 0xef, 0x2a, 0x7e,
+  0x82, 0x9d, 0xbc, 0xdf, 0x7a, 0x8e, 0x89, 0x80, 0x9b, 0xb6, 0xc1, 0x58,
+  0xe8, 0x23, 0x65, 0xaf, 0xea, 0x25, 0x6f, 0xb1, 0xc8, 0x43, 0xc5, 0x54,
+  0xfc, 0x1f, 0x21, 0x63, 0xa5, 0xf4, 0x07, 0x09, 0x1b, 0x2d, 0x77, 0x99,
+  0xb0, 0xcb, 0x46, 0xca, 0x45, 0xcf, 0x4a, 0xde, 0x79, 0x8b, 0x86, 0x91,
+  0xa8, 0xe3, 0x3e, 0x42, 0xc6, 0x51, 0xf3, 0x0e, 0x12, 0x36, 0x5a, 0xee,
+  0x29, 0x7b, 0x8d, 0x8c, 0x8f, 0x8a, 0x85, 0x94, 0xa7, 0xf2, 0x0d, 0x17,
+  0x39, 0x4b, 0xdd, 0x7c, 0x84, 0x97, 0xa2, 0xfd, 0x1c, 0x24, 0x6c, 0xb4,
+  0xc7, 0x52, 0xf6, 0x01, 0x03, 0x05, 0x0f, 0x11, 0x33, 0x55, 0xff, 0x1a,
+  0x2e, 0x72, 0x96, 0xa1, 0xf8, 0x13, 0x35, 0x5f, 0xe1, 0x38, 0x48, 0xd8,
+  0x73, 0x95, 0xa4, 0xf7, 0x02, 0x06, 0x0a, 0x1e, 0x22, 0x66, 0xaa, 0xe5,
+  0x34, 0x5c, 0xe4, 0x37, 0x59, 0xeb, 0x26, 0x6a, 0xbe, 0xd9, 0x70, 0x90,
+  0xab, 0xe6, 0x31, 0x53, 0xf5, 0x04, 0x0c, 0x14, 0x3c, 0x44, 0xcc, 0x4f,
+  0xd1, 0x68, 0xb8, 0xd3, 0x6e, 0xb2, 0xcd, 0x4c, 0xd4, 0x67, 0xa9, 0xe0,
+  0x3b, 0x4d, 0xd7, 0x62, 0xa6, 0xf1, 0x08, 0x18, 0x28, 0x78, 0x88, 0x83,
+  0x9e, 0xb9, 0xd0, 0x6b, 0xbd, 0xdc, 0x7f, 0x81, 0x98, 0xb3, 0xce, 0x49,
+  0xdb, 0x76, 0x9a, 0xb5, 0xc4, 0x57, 0xf9, 0x10, 0x30, 0x50, 0xf0, 0x0b,
+  0x1d, 0x27, 0x69, 0xbb, 0xd6, 0x61, 0xa3, 0xfe, 0x19, 0x2b, 0x7d, 0x87,
+  0x92, 0xad, 0xec, 0x2f, 0x71, 0x93, 0xae, 0xe9, 0x20, 0x60, 0xa0, 0xfb,
+  0x16, 0x3a, 0x4e, 0xd2, 0x6d, 0xb7, 0xc2, 0x5d, 0xe7, 0x32, 0x56, 0xfa,
+  0x15, 0x3f, 0x41, 0xc3, 0x5e, 0xe2, 0x3d, 0x47, 0xc9, 0x40, 0xc0, 0x5b,
+  0xed, 0x2c, 0x74, 0x9c, 0xbf, 0xda, 0x75, 0x9f, 0xba, 0xd5, 0x64, 0xac,
+  0xef, 0x2a, 0x7e, 0x82, 0x9d, 0xbc, 0xdf, 0x7a, 0x8e, 0x89, 0x80, 0x9b,
+  0xb6, 0xc1, 0x58, 0xe8, 0x23, 0x65, 0xaf, 0xea, 0x25, 0x6f, 0xb1, 0xc8,
+  0x43, 0xc5, 0x54, 0xfc, 0x1f, 0x21, 0x63, 0xa5, 0xf4, 0x07, 0x09, 0x1b,
+  0x2d, 0x77, 0x99, 0xb0, 0xcb, 0x46, 0xca, 0x45, 0xcf, 0x4a, 0xde, 0x79,
+  0x8b, 0x86, 0x91, 0xa8, 0xe3, 0x3e, 0x42, 0xc6, 0x51, 0xf3, 0x0e, 0x12,
+  0x36, 0x5a, 0xee, 0x29, 0x7b, 0x8d, 0x8c, 0x8f, 0x8a, 0x85, 0x94, 0xa7,
+  0xf2, 0x0d, 0x17, 0x39, 0x4b, 0xdd, 0x7c, 0x84, 0x97, 0xa2, 0xfd, 0x1c,
+  0x24, 0x6c, 0xb4, 0xc7, 0x52, 0xf6, 0x01, 0x03,
+};
+
+// inv(a) for a = 1..255; inv(0) is undefined and left as 0
+static const uint8_t MULTIPLICATIVE_INVERSE_TABLE[256] = {
+  0x00, 0x01, 0x8d, 0xf6, 0xcb, 0x52, 0x7b, 0xd1, 0xe8, 0x4f, 0x29, 0xc0,
+  0xb0, 0xe1, 0xe5, 0xc7, 0x74, 0xb4, 0xaa, 0x4b, 0x99, 0x2b, 0x60, 0x5f,
+  0x58, 0x3f, 0xfd, 0xcc, 0xff, 0x40, 0xee, 0xb2, 0x3a, 0x6e, 0x5a, 0xf1,
+  0x55, 0x4d, 0xa8, 0xc9, 0xc1, 0x0a, 0x98, 0x15, 0x30, 0x44, 0xa2, 0xc2,
+  0x2c, 0x45, 0x92, 0x6c, 0xf3, 0x39, 0x66, 0x42, 0xf2, 0x35, 0x20, 0x6f,
+  0x77, 0xbb, 0x59, 0x19, 0x1d, 0xfe, 0x37, 0x67, 0x2d, 0x31, 0xf5, 0x69,
+  0xa7, 0x64, 0xab, 0x13, 0x54, 0x25, 0xe9, 0x09, 0xed, 0x5c, 0x05, 0xca,
+  0x4c, 0x24, 0x87, 0xbf, 0x18, 0x3e, 0x22, 0xf0, 0x51, 0xec, 0x61, 0x17,
+  0x16, 0x5e, 0xaf, 0xd3, 0x49, 0xa6, 0x36, 0x43, 0xf4, 0x47, 0x91, 0xdf,
+  0x33, 0x93, 0x21, 0x3b, 0x79, 0xb7, 0x97, 0x85, 0x10, 0xb5, 0xba, 0x3c,
+  0xb6, 0x70, 0xd0, 0x06, 0xa1, 0xfa, 0x81, 0x82, 0x83, 0x7e, 0x7f, 0x80,
+  0x96, 0x73, 0xbe, 0x56, 0x9b, 0x9e, 0x95, 0xd9, 0xf7, 0x02, 0xb9, 0xa4,
+  0xde, 0x6a, 0x32, 0x6d, 0xd8, 0x8a, 0x84, 0x72, 0x2a, 0x14, 0x9f, 0x88,
+  0xf9, 0xdc, 0x89, 0x9a, 0xfb, 0x7c, 0x2e, 0xc3, 0x8f, 0xb8, 0x65, 0x48,
+  0x26, 0xc8, 0x12, 0x4a, 0xce, 0xe7, 0xd2, 0x62, 0x0c, 0xe0, 0x1f, 0xef,
+  0x11, 0x75, 0x78, 0x71, 0xa5, 0x8e, 0x76, 0x3d, 0xbd, 0xbc, 0x86, 0x57,
+  0x0b, 0x28, 0x2f, 0xa3, 0xda, 0xd4, 0xe4, 0x0f, 0xa9, 0x27, 0x53, 0x04,
+  0x1b, 0xfc, 0xac, 0xe6, 0x7a, 0x07, 0xae, 0x63, 0xc5, 0xdb, 0xe2, 0xea,
+  0x94, 0x8b, 0xc4, 0xd5, 0x9d, 0xf8, 0x90, 0x6b, 0xb1, 0x0d, 0xd6, 0xeb,
+  0xc6, 0x0e, 0xcf, 0xad, 0x08, 0x4e, 0xd7, 0xe3, 0x5d, 0x50, 0x1e, 0xb3,
+  0x5b, 0x23, 0x38, 0x34, 0x68, 0x46, 0x03, 0x8c, 0xdd, 0x9c, 0x7d, 0xa0,
+  0xcd, 0x1a, 0x41, 0x1c,
+};
 
 // Add two polynomials in GF(2 ^ 8)
 inline static uint8_t p_add(uint8_t a, uint8_t b) { return a ^ b; }
 
-// Multiply a polynomial by x in GF(2 ^ 8)
-inline static uint8_t time_x(uint8_t a) {
-  if ((a >> 7) & 0x1) {
-    return (a << 1) ^ IRREDUCTIBLE_POLY;
-  } else {
-    return (a << 1);
-  }
+// Multiply two polynomials in GF(2 ^ 8)
+inline static uint8_t p_mul(uint8_t a, uint8_t b) {
+  if (a == 0 || b == 0)
+    return 0;
+  return EXPONENT_TABLE[LOGARITHM_TABLE[a] + LOGARITHM_TABLE[b]];
 }
 
-inline static uint8_t time_x_power(uint8_t a, uint8_t x_power) {
-  uint8_t res = a;
-  for (; x_power > 0; x_power--) {
-    res = time_x(res);
-  }
-  return res;
+// Multiplicative inverse of a polynomial in GF(2 ^ 8)
+inline static uint8_t p_inv(uint8_t a) {
+  return MULTIPLICATIVE_INVERSE_TABLE[a];
 }
 
-// Multiply two polynomials in GF(2 ^ 8)
-inline static uint8_t p_mul(uint8_t a, uint8_t b) {
-  uint8_t res = 0;
-  for (int degree = 7; degree >= 0; degree--) {
-    if ((b >> degree) & 0x1) {
-      res = p_add(res, time_x_power(a, degree));
-    }
+// Divide two polynomials in GF(2 ^ 8)
+inline static uint8_t p_div(uint8_t a, uint8_t b) {
+  if (a == 0)
+    return 0;
+  return EXPONENT_TABLE[LOGARITHM_TABLE[a] + 255 - LOGARITHM_TABLE[b]];
+}
+
+// Multiply a byte vector by a constant and add it into an accumulator
+inline static void p_mul_add(uint8_t c, const uint8_t *src, uint8_t *dst,
+                             size_t len) {
+  if (c == 0)
+    return;
+  int log_c = LOGARITHM_TABLE[c];
+  for (size_t i = 0; i < len; i++) {
+    if (src[i] != 0)
+      dst[i] ^= EXPONENT_TABLE[log_c + LOGARITHM_TABLE[src[i]]];
   }
-  return res;
 }
 
-inline static uint8_t p_inv(uint8_t a) {
+#include "gf256_bitslice.c"
+#include "gf256_simd.c"
+#include "gf65536.c"
 
-  // Build the table so that table[a][1] = inv(a)
-  if (MULTIPLICATIVE_INVERSE_TABLE == NULL) {
-    MULTIPLICATIVE_INVERSE_TABLE = (uint8_t **)malloc(256 * sizeof(uint8_t *));
-    for (int row = 0; row < 256; row++) {
-      MULTIPLICATIVE_INVERSE_TABLE[row] =
-          (uint8_t *)malloc(256 * sizeof(uint8_t));
+typedef void (*p_dot_func)(const uint8_t *cs, const uint8_t *const *srcs,
+                           int cnt, uint8_t *dst, size_t len);
 
-      for (int col = 0; col < 256; col++) {
-        MULTIPLICATIVE_INVERSE_TABLE[row][p_mul(row, col)] = col;
-      }
-    }
+// Add the dot product of the constants and the source vectors into dst, one
+// multiply-accumulate per term
+#define P_DOT_FROM_MUL_ADD(name, mul_add)                                      \
+  static void name(const uint8_t *cs, const uint8_t *const *srcs, int cnt,     \
+                   uint8_t *dst, size_t len) {                                 \
+    for (int j = 0; j < cnt; j++)                                              \
+      mul_add(cs[j], srcs[j], dst, len);                                       \
   }
-  return MULTIPLICATIVE_INVERSE_TABLE[a][1];
-}
 
-// Divide two polynomials in GF(2 ^ 8)
-inline static uint8_t p_div(uint8_t a, uint8_t b) { return p_mul(a, p_inv(b)); }
+P_DOT_FROM_MUL_ADD(p_dot, p_mul_add)
+#if defined(HAVE_GF256_SIMD)
+P_DOT_FROM_MUL_ADD(p_dot_ssse3, p_mul_add_ssse3)
+P_DOT_FROM_MUL_ADD(p_dot_avx2, p_mul_add_avx2)
+#endif
+
+// The implementations of the dot product kernel, best last
+static struct {
+  const char *name;
+  p_dot_func func;
+  int available;
+} P_DOT_ENGINES[] = {
+    {"scalar", p_dot, 1},
+    {"bitslice", p_dot_bitslice, 1},
+#if defined(HAVE_GF256_SIMD)
+    {"ssse3", p_dot_ssse3, 0},
+    {"avx2", p_dot_avx2, 0},
+#endif
+};
+
+#define P_DOT_ENGINES_NUM                                                      \
+  ((int)(sizeof(P_DOT_ENGINES) / sizeof(*P_DOT_ENGINES)))
 
-inline static uint8_t rand_byte() { return rand() % 0xff; }
+// The kernel split and join use by default, the best available one. Each
+// Lua state keeps its own, changed with sss.engine().
+static int p_dot_default = 0;
 
-inline static uint8_t *make_random_poly(int degree, uint8_t secret) {
-  uint8_t *poly = malloc((degree + 1) * sizeof(uint8_t));
-  for (; degree > 0; degree--) {
-    poly[degree] = rand_byte();
+static void p_dot_detect(void) {
+#if defined(HAVE_GF256_SIMD)
+  __builtin_cpu_init();
+  P_DOT_ENGINES[2].available = __builtin_cpu_supports("ssse3");
+  P_DOT_ENGINES[3].available = __builtin_cpu_supports("avx2");
+#endif
+  // Table lookups index memory with secret bytes: prefer the bitsliced
+  // kernel when no vector kernel is available.
+  for (int i = 0; i < P_DOT_ENGINES_NUM; i++) {
+    if (P_DOT_ENGINES[i].available)
+      p_dot_default = i;
   }
-  poly[0] = secret;
-  return poly;
 }
 
-inline static uint8_t poly_eval(uint8_t *poly, int degree, uint8_t x) {
-  uint8_t res = 0;
-  for (; degree >= 0; degree--) {
-    uint8_t coeff = poly[degree];
-    uint8_t term = 0x01;
-    for (int times = degree; times > 0; times--) {
-      term = p_mul(term, x);
-    }
-    res = p_add(res, p_mul(coeff, term));
+#if defined(PTHREADS)
+static pthread_once_t p_dot_once = PTHREAD_ONCE_INIT;
+#else
+static int p_dot_ready = 0;
+#endif
+
+// Detect the kernels the CPU supports, once for all the Lua states
+static void p_dot_select(void) {
+#if defined(PTHREADS)
+  pthread_once(&p_dot_once, p_dot_detect);
+#else
+  if (!p_dot_ready) {
+    p_dot_detect();
+    p_dot_ready = 1;
   }
-  return res;
+#endif
 }
 
-// Interpolate a(k - 1) degree polynomial and evaluate it at x = 0
-inline static uint8_t poly_interpolate(uint8_t *xs, uint8_t *ys, int k) {
-  uint8_t res = 0;
-
+// Compute the Lagrange basis polynomials of the k x points evaluated at x = 0.
+// They only depend on the x points so they are shared by all secret bytes.
+// Returns 0 when two x points are equal and the secret can't be recovered.
+inline static int lagrange_coeffs(const uint8_t *xs, int k, uint8_t *coeffs) {
   for (int j = 0; j < k; j++) {
     uint8_t prod = 0x01;
     for (int m = 0; m < k; m++) {
       if (m != j) {
+        if (xs[m] == xs[j])
+          return 0;
         prod = p_mul(prod, p_div(xs[m], p_add(xs[m], xs[j])));
       }
     }
-    res = p_add(res, p_mul(ys[j], prod));
+    coeffs[j] = prod;
   }
-  return res;
+  return 1;
 }
 
-inline static uint8_t **split(uint8_t *secret, int secret_size, int n, int k) {
-  // n rows x(secret_size + 1) cols matrix
-  uint8_t **shares = malloc(n * sizeof(uint8_t *));
-  for (int i = 0; i < n; i++) {
-    shares[i] = malloc((secret_size + 1) * sizeof(uint8_t));
+// Secret bytes handled per pass of split and join, sized so that the rows of a
+// block stay in cache while every row of the other matrix is visited.
+#define BLOCK_SIZE 1024
 
-    // x
-    shares[i][0] = rand_byte();
+// Random bytes consumed by split: the k - 1 rows of secret_size
+// coefficients of degree 1 .. k - 1
+#define SPLIT_RANDOM_SIZE(secret_size, k) ((size_t)((k) - 1) * (secret_size))
+
+// The powers x^0 .. x^(k - 1) of each of the n x coordinates
+inline static void split_powers(const uint8_t *xs, int n, int k,
+                                uint8_t *powers) {
+  for (int i = 0; i < n; i++) {
+    powers[i * k] = 0x01;
+    for (int j = 1; j < k; j++)
+      powers[i * k + j] = p_mul(powers[i * k + j - 1], xs[i]);
   }
+}
 
-  for (int secret_idx = 0; secret_idx < secret_size; secret_idx++) {
-    uint8_t *poly = make_random_poly(k - 1, secret[secret_idx]);
+// Evaluate the random polynomials of all the secret bytes on every x point.
+// The y values are the product of the n x k matrix of x powers (Vandermonde)
+// and the k x secret_size matrix of coefficients, whose first row is the
+// secret itself and the others the k - 1 rows of coeffs.
+inline static void split_eval(p_dot_func dot, const uint8_t *secret,
+                              size_t secret_size, int n, int k,
+                              const uint8_t *powers,
+                              const uint8_t *const *coeffs,
+                              uint8_t *const *ys) {
+  const uint8_t *rows[255];
 
-    // Evaluate poly on every one of the n x points
+  for (size_t off = 0; off < secret_size; off += BLOCK_SIZE) {
+    size_t len = secret_size - off;
+    if (len > BLOCK_SIZE)
+      len = BLOCK_SIZE;
+
+    for (int j = 0; j < k - 1; j++)
+      rows[j] = coeffs[j] + off;
+
+    // Each share row of the block is written sequentially
     for (int i = 0; i < n; i++) {
-      shares[i][secret_idx + 1] = poly_eval(poly, k - 1, shares[i][0]);
+      uint8_t *y = ys[i] + off;
+      memcpy(y, secret + off, len);
+      dot(powers + i * k + 1, rows, k - 1, y, len);
     }
   }
+}
 
-  return shares;
+// Split the secret into n shares of secret_size + 1 bytes, the x coordinate
+// followed by the y values. powers holds the n * k powers of the xs and rnd
+// SPLIT_RANDOM_SIZE bytes.
+inline static void split(p_dot_func dot, const uint8_t *secret,
+                         size_t secret_size, int n, int k,
+                         uint8_t *const *shares, const uint8_t *xs,
+                         const uint8_t *powers, const uint8_t *rnd) {
+  const uint8_t *coeffs[255];
+  uint8_t *ys[255];
+
+  for (int i = 0; i < n; i++) {
+    shares[i][0] = xs[i];
+    ys[i] = shares[i] + 1;
+  }
+  for (int j = 0; j < k - 1; j++)
+    coeffs[j] = rnd + j * secret_size;
+  split_eval(dot, secret, secret_size, n, k, powers, coeffs, ys);
 }
 
-inline static uint8_t *join(uint8_t **shares, int secret_size, int k) {
-  uint8_t *secret = malloc(secret_size * sizeof(uint8_t));
+// Each secret byte is the dot product of the Lagrange coefficients with the
+// column of y values at the same offset.
+inline static void join(p_dot_func dot, const uint8_t *const *ys,
+                        size_t secret_size, int k, const uint8_t *coeffs,
+                        uint8_t *secret) {
+  const uint8_t *cols[256];
 
-  for (int secret_idx = 1; secret_idx <= secret_size; secret_idx++) {
-    uint8_t *xs = (uint8_t *)malloc(k * sizeof(uint8_t));
-    uint8_t *ys = (uint8_t *)malloc(k * sizeof(uint8_t));
-    for (int i = 0; i < k; i++) {
-      xs[i] = shares[i][0];
-      ys[i] = shares[i][secret_idx];
+  memset(secret, 0, secret_size);
+  for (size_t off = 0; off < secret_size; off += BLOCK_SIZE) {
+    size_t len = secret_size - off;
+    if (len > BLOCK_SIZE)
+      len = BLOCK_SIZE;
 
-      secret[secret_idx - 1] = poly_interpolate(xs, ys, k);
-    }
+    for (int i = 0; i < k; i++)
+      cols[i] = ys[i] + off;
+    dot(coeffs, cols, k, secret + off, len);
   }
-
-  return secret;
 }
-#else
 
 #include <openssl/bn.h>
 
 #include "share.c"
 #include "share_openssl.c"
+#include "share_native.c"
 
-#endif
+#include "sss_arena.c"
+#include "sss_buffer.c"
+#include "sss_cache.c"
+#include "sss_shareset.c"
+#include "sss_pool.c"
+#include "sss_rng.c"
 
-static int create_shares(lua_State *L) {
+// Powers of the x coordinates of the last split, kept as long as the next
+// splits use the same ones
+typedef struct powers_table_st {
+  int n;
+  int k;
+  uint8_t xs[255];
+  // n * k bytes
+  sss_buffer powers;
+} powers_table;
+
+// The powers of the n xs up to k - 1, computed again only when they changed.
+// Returns NULL when out of memory.
+static const uint8_t *powers_table_get(powers_table *table,
+                                       const uint16_t *xs, int n, int k) {
+  int same = table->n == n && table->k == k;
+
+  for (int i = 0; same && i < n; i++)
+    same = table->xs[i] == xs[i];
+  if (same)
+    return table->powers.data;
+
+  table->n = 0;
+  if (!buffer_reserve(&table->powers, (size_t)n * k))
+    return NULL;
+  for (int i = 0; i < n; i++)
+    table->xs[i] = (uint8_t)xs[i];
+  split_powers(table->xs, n, k, table->powers.data);
+  table->n = n;
+  table->k = k;
+  return table->powers.data;
+}
+
+// The state of the module kept for each Lua state
+typedef struct sss_state_st {
+  // Lagrange weights of recently combined share sets
+  weights_cache cache;
+  // Temporaries of split and join, and results before they are pushed as
+  // strings
+  sss_arena arena;
+  // Items of the splits and joins of a call
+  sss_buffer items;
+  // Threads working on the splits and joins
+  sss_pool pool;
+  // Random bytes of the calling thread
+  sss_rng rng;
+  // Powers of the x coordinates of the GF(2 ^ 8) splits
+  powers_table powers;
+  // x coordinates and rows of the shares of a call
+  sss_buffer shares;
+  // x coordinates and Lagrange coefficients of the GF(2 ^ 16) joins
+  sss_buffer lagrange;
+  // Field of the splits and joins not given one
+  const struct shares_backend_st *backend;
+  // Prime field share objects of each thread, allocated on first use
+  struct share_slot_st *slots;
+  // Name of the implementation of the prime field share objects, the first
+  // that supports a secret when empty
+  char prime_impl[32];
+  // Index of the GF(2 ^ 8) dot product kernel in P_DOT_ENGINES
+  int engine;
+} sss_state;
+
+// The GF(2 ^ 8) dot product kernel of the state
+#define sss_state_dot(state) (P_DOT_ENGINES[(state)->engine].func)
+
+#define SSS_STATE_MT "sss.state"
+
+// The state is the first upvalue of every function of the module
+#define sss_state_get(L) ((sss_state *)lua_touserdata(L, lua_upvalueindex(1)))
+
+static void share_slots_free(sss_state *state);
+
+// Stop the threads and wipe and release the memory of the state
+static void sss_state_free(sss_state *state) {
+  pool_free(&state->pool);
+  share_slots_free(state);
+  weights_cache_free(&state->cache);
+  arena_free(&state->arena);
+  buffer_free(&state->items);
+  rng_free(&state->rng);
+  buffer_free(&state->powers.powers);
+  buffer_free(&state->shares);
+  buffer_free(&state->lagrange);
+}
+
+static int sss_state_gc(lua_State *L) {
+  sss_state_free((sss_state *)luaL_checkudata(L, 1, SSS_STATE_MT));
+  return 0;
+}
+
+// A secret to split
+typedef struct split_item_st {
+  const uint8_t *secret;
   size_t sz;
-  uint8_t n, k;
+  // The n shares of the secret
+  uint8_t **rows;
+  // Random bytes of the split, GF(2 ^ 8) only
+  const uint8_t *rnd;
+  // Whether the split succeeded
+  int ok;
+} split_item;
 
-  const char *secret = luaL_checklstring(L, 1, &sz);
+// Shares to join into a secret
+typedef struct join_item_st {
+  uint8_t **rows;
+  // Length of each share
+  size_t size;
+  // Number of shares
+  int n;
+  uint8_t *secret;
+  // Lagrange coefficients, GF(2 ^ 8) only
+  uint8_t coeffs[255];
+  // Lagrange coefficients, GF(2 ^ 16) only, in the lagrange buffer of the
+  // state
+  uint16_t *coeffs16;
+  // Whether the join succeeded
+  int ok;
+} join_item;
 
-  n = (uint8_t)luaL_checkinteger(L, 2);
-  k = (uint8_t)luaL_checkinteger(L, 3);
+// A split or join run by the thread pool
+typedef struct shares_job_st {
+  sss_state *state;
+  split_item *split;
+  join_item *join;
+  int n;
+  int k;
+  // The x coordinates of the shares of a split
+  const uint16_t *xs;
+  // Their powers, GF(2 ^ 8) only
+  const uint8_t *powers;
+  // Format of the shares, prime field only
+  SHARE_FORMAT format;
+} shares_job;
 
-  luaL_argcheck(L, n >= k && k > 1, 3, "out of range");
+// The GF(2 ^ 8) backend: shares are the x coordinate byte followed by one y
+// byte for each secret byte
 
-#if !defined(USE_OPENSSL)
-  uint8_t **shares = split((uint8_t *)secret, sz, n, k);
-  if (shares != NULL) {
-    lua_newtable(L);
-    for (k = 0; k < n; k++) {
-      lua_pushlstring(L, (const char *)shares[k], sz + 1);
-      lua_rawseti(L, -2, k + 1);
-      free(shares[k]);
-    }
-    free(shares);
+// Fewest blocks of a secret, and secrets of a batch, worth a thread
+#define GF_GRAIN_BLOCKS 64
+#define GF_GRAIN_ITEMS 64
+
+// Largest x coordinate of a share
+#define GF_X_MAX 255
+
+// Length of each share of a secret of sz bytes, 0 when not supported
+static size_t gf_row_len(size_t sz) { return sz + 1; }
+
+// Length of the secret recovered from shares of size bytes
+static size_t gf_secret_len(size_t size) { return size - 1; }
+
+static void gf_split_items_task(void *arg, int t, size_t begin, size_t end) {
+  shares_job *job = (shares_job *)arg;
+  const uint8_t *xs = job->state->powers.xs;
+
+  (void)t;
+  for (size_t i = begin; i < end; i++) {
+    split_item *item = &job->split[i];
+    split(sss_state_dot(job->state), item->secret, item->sz, job->n, job->k,
+          item->rows, xs, job->powers, item->rnd);
+    item->ok = 1;
+  }
+}
+
+// Evaluate the blocks begin to end - 1 of a single secret
+static void gf_split_blocks_task(void *arg, int t, size_t begin, size_t end) {
+  shares_job *job = (shares_job *)arg;
+  split_item *item = job->split;
+  size_t off = begin * BLOCK_SIZE, last = end * BLOCK_SIZE;
+  const uint8_t *coeffs[255];
+  uint8_t *ys[255];
+
+  (void)t;
+  if (last > item->sz)
+    last = item->sz;
+  for (int j = 0; j < job->k - 1; j++)
+    coeffs[j] = item->rnd + j * item->sz + off;
+  for (int i = 0; i < job->n; i++)
+    ys[i] = item->rows[i] + 1 + off;
+  split_eval(sss_state_dot(job->state), item->secret + off, last - off,
+             job->n, job->k, job->powers, coeffs, ys);
+}
+
+// Arena space gf_split_run takes for the cnt secrets
+static size_t gf_split_scratch(const split_item *items, size_t cnt,
+                                   int k) {
+  size_t len = 0;
+
+  for (size_t i = 0; i < cnt; i++)
+    len += SPLIT_RANDOM_SIZE(items[i].sz, k);
+  return ARENA_SIZE(len);
+}
+
+// Split the cnt secrets into n shares at the x coordinates xs with a
+// threshold of k. The powers of the xs are shared by all the threads and
+// splits, and the randomness of all of them is drawn at once into the arena
+// of the call. A single secret is cut in byte ranges among the threads, a
+// batch in secrets. Returns 0 when out of memory.
+static int gf_split_run(sss_state *state, split_item *items, size_t cnt,
+                            int n, int k, const uint16_t *xs) {
+  shares_job job = {.state = state, .split = items, .n = n, .k = k, .xs = xs};
+  size_t rnd_len = 0;
+  uint8_t *rnd;
+
+  job.powers = powers_table_get(&state->powers, xs, n, k);
+  if (job.powers == NULL)
+    return 0;
+  for (size_t i = 0; i < cnt; i++)
+    rnd_len += SPLIT_RANDOM_SIZE(items[i].sz, k);
+  rnd = (uint8_t *)arena_alloc(&state->arena, rnd_len);
+  if (rnd == NULL && rnd_len > 0)
+    return 0;
+  rng_bytes(&state->rng, rnd, rnd_len);
+  for (size_t i = 0; i < cnt; i++) {
+    items[i].rnd = rnd;
+    rnd += SPLIT_RANDOM_SIZE(items[i].sz, k);
+  }
+
+  if (cnt == 1) {
+    for (int i = 0; i < n; i++)
+      items->rows[i][0] = (uint8_t)xs[i];
+    pool_run(&state->pool, gf_split_blocks_task, &job,
+             (items->sz + BLOCK_SIZE - 1) / BLOCK_SIZE, GF_GRAIN_BLOCKS);
+    items->ok = 1;
+  } else {
+    pool_run(&state->pool, gf_split_items_task, &job, cnt, GF_GRAIN_ITEMS);
+  }
+  return 1;
+}
+
+// The Lagrange coefficients of the x coordinates of the item, the first
+// byte of each share. Returns 0 when two are equal.
+static int gf_join_coeffs(sss_state *state, join_item *item) {
+  const uint8_t *const *rows = (const uint8_t *const *)item->rows;
+  uint8_t xs[255];
+
+  // More shares than x coordinates repeat some
+  if (item->n > GF_X_MAX)
+    return 0;
+  if (weights_cache_get(&state->cache, 0, item->n, 1, rows, 1, item->coeffs))
     return 1;
+  for (int i = 0; i < item->n; i++)
+    xs[i] = rows[i][0];
+  if (!lagrange_coeffs(xs, item->n, item->coeffs))
+    return 0;
+  weights_cache_put(&state->cache, 0, item->n, 1, rows, 1, item->coeffs);
+  return 1;
+}
+
+// Join the bytes off to last - 1 of the secret of the item
+static void gf_join_range(const sss_state *state, join_item *item, size_t off,
+                          size_t last) {
+  const uint8_t *ys[255];
+
+  for (int i = 0; i < item->n; i++)
+    ys[i] = item->rows[i] + 1 + off;
+  join(sss_state_dot(state), ys, last - off, item->n, item->coeffs,
+       item->secret + off);
+}
+
+static void gf_join_items_task(void *arg, int t, size_t begin, size_t end) {
+  shares_job *job = (shares_job *)arg;
+
+  (void)t;
+  for (size_t i = begin; i < end; i++) {
+    join_item *item = &job->join[i];
+    if (item->ok)
+      gf_join_range(job->state, item, 0, gf_secret_len(item->size));
   }
-#else
+}
+
+static void gf_join_blocks_task(void *arg, int t, size_t begin, size_t end) {
+  shares_job *job = (shares_job *)arg;
+  size_t len = gf_secret_len(job->join->size);
+  size_t last = end * BLOCK_SIZE;
+
+  (void)t;
+  gf_join_range(job->state, job->join, begin * BLOCK_SIZE,
+                last < len ? last : len);
+}
+
+// Recover the secrets of the cnt items, cut among the threads like splits
+static void gf_join_run(sss_state *state, join_item *items, size_t cnt) {
+  shares_job job = {.state = state, .join = items};
+
+  for (size_t i = 0; i < cnt; i++)
+    items[i].ok = gf_join_coeffs(state, &items[i]);
+
+  if (cnt == 1) {
+    size_t len = gf_secret_len(items->size);
+    if (items->ok)
+      pool_run(&state->pool, gf_join_blocks_task, &job,
+               (len + BLOCK_SIZE - 1) / BLOCK_SIZE, GF_GRAIN_BLOCKS);
+  } else {
+    pool_run(&state->pool, gf_join_items_task, &job, cnt, GF_GRAIN_ITEMS);
+  }
+}
+
+// The GF(2 ^ 16) backend: shares are the x coordinate on two bytes followed
+// by the y symbols of the secret. A secret of odd length is padded at the
+// end with a zero byte, and its shares end with the count of pad bytes, 1,
+// so that their odd length tells the padding from the secret.
+// There are 65535 x coordinates, and thresholds are not limited to 255.
+
+// Fewest shares of a single secret, and secrets of a batch, worth a thread
+#define GF65536_GRAIN_SHARES 16
+#define GF65536_GRAIN_ITEMS 16
+
+// Fewest blocks of a single secret worth a thread when joining
+#define GF65536_GRAIN_BLOCKS 64
+
+// Largest x coordinate of a share
+#define GF65536_X_MAX 65535
+
+// Length of the symbols of a secret of sz bytes
+#define GF65536_SYMBOLS_LEN(sz) ((sz) + ((sz) & 1))
+
+static size_t gf65536_row_len(size_t sz) {
+  return 2 + GF65536_SYMBOLS_LEN(sz) + (sz & 1);
+}
+
+static size_t gf65536_secret_len(size_t size) {
+  // Less the padding and the pad count byte of odd lengths
+  if (size & 1)
+    return size < 5 ? 0 : size - 4;
+  return size - 2;
+}
+
+// Evaluate the polynomials of the secret of the item on the x coordinates of
+// the shares begin to end - 1 with Horner's rule, from the coefficients of
+// degree k - 1 down to the secret
+static void gf65536_split_shares(const split_item *item, int k,
+                                 const uint16_t *xs, size_t begin,
+                                 size_t end) {
+  size_t len = GF65536_SYMBOLS_LEN(item->sz);
+
+  for (size_t i = begin; i < end; i++) {
+    gf65536_store(item->rows[i], xs[i]);
+    if (item->sz & 1)
+      item->rows[i][2 + len] = 1;
+  }
+  for (size_t off = 0; off < len; off += BLOCK_SIZE) {
+    size_t blk = len - off < BLOCK_SIZE ? len - off : BLOCK_SIZE;
+
+    for (size_t i = begin; i < end; i++) {
+      uint8_t *y = item->rows[i] + 2 + off;
+      memcpy(y, item->rnd + (k - 2) * len + off, blk);
+      for (int j = k - 3; j >= 0; j--)
+        gf65536_horner(xs[i], item->rnd + j * len + off, y, blk);
+      gf65536_horner(xs[i], item->secret + off, y, blk);
+    }
+  }
+}
+
+static void gf65536_split_items_task(void *arg, int t, size_t begin,
+                                     size_t end) {
+  shares_job *job = (shares_job *)arg;
+
+  (void)t;
+  for (size_t i = begin; i < end; i++) {
+    gf65536_split_shares(&job->split[i], job->k, job->xs, 0, job->n);
+    job->split[i].ok = 1;
+  }
+}
+
+static void gf65536_split_shares_task(void *arg, int t, size_t begin,
+                                      size_t end) {
+  shares_job *job = (shares_job *)arg;
+
+  (void)t;
+  gf65536_split_shares(job->split, job->k, job->xs, begin, end);
+}
+
+// Arena space gf65536_split_run takes for the cnt secrets: the random
+// coefficients and a padded copy of the secrets of odd length
+static size_t gf65536_split_scratch(const split_item *items, size_t cnt,
+                                    int k) {
+  size_t len = 0;
+
+  for (size_t i = 0; i < cnt; i++) {
+    size_t sz = GF65536_SYMBOLS_LEN(items[i].sz);
+    len += SPLIT_RANDOM_SIZE(sz, k) + (items[i].sz & 1 ? sz : 0);
+  }
+  return ARENA_SIZE(len);
+}
+
+// Split the cnt secrets into n shares at the x coordinates xs with a
+// threshold of k. The secrets of odd length are replaced with a copy padded
+// at the end in the arena. A single secret is cut in shares among the
+// threads, a batch in secrets. Returns 0 when out of memory.
+static int gf65536_split_run(sss_state *state, split_item *items, size_t cnt,
+                             int n, int k, const uint16_t *xs) {
+  shares_job job = {.state = state, .split = items, .n = n, .k = k, .xs = xs};
+  size_t rnd_len = 0;
+  uint8_t *rnd;
+
+  for (size_t i = 0; i < cnt; i++)
+    rnd_len += SPLIT_RANDOM_SIZE(GF65536_SYMBOLS_LEN(items[i].sz), k);
+  rnd = (uint8_t *)arena_alloc(&state->arena, rnd_len);
+  if (rnd == NULL && rnd_len > 0)
+    return 0;
+  rng_bytes(&state->rng, rnd, rnd_len);
+  for (size_t i = 0; i < cnt; i++) {
+    items[i].rnd = rnd;
+    rnd += SPLIT_RANDOM_SIZE(GF65536_SYMBOLS_LEN(items[i].sz), k);
+    if (items[i].sz & 1) {
+      uint8_t *padded = (uint8_t *)arena_alloc(&state->arena, items[i].sz + 1);
+      if (padded == NULL)
+        return 0;
+      memcpy(padded, items[i].secret, items[i].sz);
+      padded[items[i].sz] = 0;
+      items[i].secret = padded;
+    }
+  }
+
+  if (cnt == 1) {
+    pool_run(&state->pool, gf65536_split_shares_task, &job, n,
+             GF65536_GRAIN_SHARES);
+    items->ok = 1;
+  } else {
+    pool_run(&state->pool, gf65536_split_items_task, &job, cnt,
+             GF65536_GRAIN_ITEMS);
+  }
+  return 1;
+}
+
+// The Lagrange coefficients of the x coordinates of the item, the first two
+// bytes of each share, into its coeffs16 with xs as room for the
+// coordinates. Returns 0 when two are equal or one is zero, or when a share
+// of odd length doesn't end with the pad count.
+static int gf65536_join_coeffs(join_item *item, uint16_t *xs) {
+  for (int i = 0; i < item->n; i++) {
+    if ((item->size & 1) && item->rows[i][item->size - 1] != 1)
+      return 0;
+    xs[i] = gf65536_load(item->rows[i]);
+  }
+  return gf65536_lagrange(xs, item->n, item->coeffs16);
+}
+
+// Join the bytes off to last - 1 of the secret of the item
+static void gf65536_join_range(join_item *item, size_t off, size_t last) {
+  size_t even = last & ~(size_t)1;
+
+  memset(item->secret + off, 0, last - off);
+  for (; off < even; off += BLOCK_SIZE) {
+    size_t blk = even - off < BLOCK_SIZE ? even - off : BLOCK_SIZE;
+
+    for (int i = 0; i < item->n; i++)
+      gf65536_mul_add(item->coeffs16[i], item->rows[i] + 2 + off,
+                      item->secret + off, blk);
+  }
+  // The last symbol of a secret of odd length ends with the padding
+  if (last != even) {
+    uint8_t sym[2] = {0, 0};
+
+    for (int i = 0; i < item->n; i++)
+      gf65536_mul_add(item->coeffs16[i], item->rows[i] + 2 + even, sym, 2);
+    item->secret[even] = sym[0];
+    sss_wipe(sym, sizeof(sym));
+  }
+}
+
+static void gf65536_join_items_task(void *arg, int t, size_t begin,
+                                    size_t end) {
+  shares_job *job = (shares_job *)arg;
+
+  (void)t;
+  for (size_t i = begin; i < end; i++) {
+    join_item *item = &job->join[i];
+    item->ok = gf65536_join_coeffs(item, item->coeffs16 + item->n);
+    if (item->ok)
+      gf65536_join_range(item, 0, gf65536_secret_len(item->size));
+  }
+}
+
+static void gf65536_join_blocks_task(void *arg, int t, size_t begin,
+                                     size_t end) {
+  shares_job *job = (shares_job *)arg;
+  size_t len = gf65536_secret_len(job->join->size);
+  size_t last = end * BLOCK_SIZE;
+
+  (void)t;
+  gf65536_join_range(job->join, begin * BLOCK_SIZE, last < len ? last : len);
+}
+
+// Recover the secrets of the cnt items, cut among the threads like the
+// GF(2 ^ 8) joins. The coefficients of each item are followed by room for
+// its x coordinates in the lagrange buffer of the state.
+static void gf65536_join_run(sss_state *state, join_item *items, size_t cnt) {
+  shares_job job = {.state = state, .join = items};
+  size_t total = 0;
+  uint16_t *coeffs;
+
+  for (size_t i = 0; i < cnt; i++)
+    total += items[i].n;
+  if (!buffer_reserve(&state->lagrange, 2 * total * sizeof(uint16_t))) {
+    for (size_t i = 0; i < cnt; i++)
+      items[i].ok = 0;
+    return;
+  }
+  coeffs = (uint16_t *)state->lagrange.data;
+  for (size_t i = 0; i < cnt; i++) {
+    items[i].coeffs16 = coeffs;
+    coeffs += 2 * items[i].n;
+  }
+
+  if (cnt == 1) {
+    size_t len = gf65536_secret_len(items->size);
+    items->ok = gf65536_join_coeffs(items, items->coeffs16 + items->n);
+    if (items->ok)
+      pool_run(&state->pool, gf65536_join_blocks_task, &job,
+               (len + BLOCK_SIZE - 1) / BLOCK_SIZE, GF65536_GRAIN_BLOCKS);
+  } else {
+    pool_run(&state->pool, gf65536_join_items_task, &job, cnt,
+             GF65536_GRAIN_ITEMS);
+  }
+}
+
+// The prime field backend of share.c: shares are the x and y coordinates
+// encoded on the length of the prime. Secrets longer than 32 bytes are cut
+// in blocks of 32 bytes, padded at the front, and their shares are the x
+// coordinate followed by the y coordinate of each block. The compact
+// backend encodes the x coordinate in a version byte and two bytes instead,
+// nearly halving the shares of secrets of one block.
+
+// Fewest secrets of a batch worth a thread
+#define PRIME_GRAIN_ITEMS 8
+
+// Largest x coordinate of a share
+#define PRIME_X_MAX 65535
+
+// Longest secret, the most bits share.c takes
+#define PRIME_SECRET_MAX (65535 / 8)
+
+// Length of the secret in each block of a long secret
+#define PRIME_BLOCK_LEN (sizeof(prime_256) - 1)
+
+static size_t prime_row_len(size_t sz) {
+  const uint8_t *data;
+  uint16_t len, bits, blocks;
+
+  if (sz == 0 || sz > PRIME_SECRET_MAX)
+    return 0;
+  if (share_blocks_get(sz * 8, &data, &len, &bits, &blocks) != NONE)
+    return 0;
+  return len * (1 + blocks);
+}
+
+static size_t prime_secret_len(size_t size) {
+  if (size <= 2 * sizeof(prime_256))
+    return (size - 2) / 2;
+  return (size / sizeof(prime_256) - 1) * PRIME_BLOCK_LEN;
+}
+
+// Length of the x coordinate of shares of size bytes
+static size_t prime_x_len(size_t size) {
+  if (size <= 2 * sizeof(prime_256))
+    return size / 2;
+  return sizeof(prime_256);
+}
+
+// Length of the version byte and x coordinate of compact shares
+#define PRIME_COMPACT_X_LEN 3
+
+static size_t prime_compact_row_len(size_t sz) {
+  size_t len = prime_row_len(sz);
+
+  // One y coordinate less long than the prime in place of the x coordinate
+  if (len == 0)
+    return 0;
+  if (len <= 2 * sizeof(prime_256))
+    return PRIME_COMPACT_X_LEN + len / 2;
+  return PRIME_COMPACT_X_LEN + len - sizeof(prime_256);
+}
+
+// Length of the prime of compact shares of size bytes
+static size_t prime_compact_len(size_t size) {
+  size_t ys = size - PRIME_COMPACT_X_LEN;
+
+  return ys <= sizeof(prime_256) ? ys : sizeof(prime_256);
+}
+
+static size_t prime_compact_secret_len(size_t size) {
+  size_t ys = size - PRIME_COMPACT_X_LEN;
+
+  if (size <= PRIME_COMPACT_X_LEN + 1)
+    return 0;
+  if (ys <= sizeof(prime_256))
+    return ys - 1;
+  return ys / sizeof(prime_256) * PRIME_BLOCK_LEN;
+}
+
+// Share objects kept by each thread between calls, for the most recent
+// secret lengths and thresholds. Setting one up decodes the prime and
+// allocates its numbers and reduction context, so they are reused, cleared
+// of the secrets after every split and join.
+#define SHARE_SLOTS 4
+
+typedef struct share_slot_st {
+  SHARE *share;
+  size_t len;
+  int k;
+  SHARE_FORMAT format;
+} share_slot;
+
+// The name of the implementation of the share objects, NULL for the default
+static const char *prime_impl_name(const sss_state *state) {
+  return state->prime_impl[0] != '\0' ? state->prime_impl : NULL;
+}
+
+// Allocate the slots of all the threads. Returns 0 when out of memory.
+static int share_slots_init(sss_state *state) {
+  if (state->slots == NULL)
+    state->slots = (share_slot *)calloc(POOL_THREADS_MAX * SHARE_SLOTS,
+                                        sizeof(share_slot));
+  return state->slots != NULL;
+}
+
+static void share_slots_free(sss_state *state) {
+  if (state->slots == NULL)
+    return;
+  for (int i = 0; i < POOL_THREADS_MAX * SHARE_SLOTS; i++)
+    SHARE_free(state->slots[i].share);
+  free(state->slots);
+  state->slots = NULL;
+}
+
+// The share object of thread t for secrets of len bytes, a threshold of k
+// and shares in the format, created in place of the least recently used one
+// when missing
+static SHARE_ERR share_slot_get(sss_state *state, int t, size_t len, int k,
+                                SHARE_FORMAT format, SHARE **share) {
+  share_slot *slots = state->slots + t * SHARE_SLOTS;
+  share_slot hit;
+  SHARE_ERR err = NONE;
+  int i;
+
+  for (i = 0; i < SHARE_SLOTS - 1; i++) {
+    if (slots[i].share != NULL && slots[i].len == len && slots[i].k == k &&
+        slots[i].format == format)
+      break;
+  }
+  hit = slots[i];
+  memmove(slots + 1, slots, i * sizeof(*slots));
+  if (hit.share == NULL || hit.len != len || hit.k != k ||
+      hit.format != format) {
+    SHARE_free(hit.share);
+    hit.share = NULL;
+    hit.len = len;
+    hit.k = k;
+    hit.format = format;
+    err = SHARE_new_impl(len * 8, k, prime_impl_name(state), &hit.share);
+    if (err == NONE)
+      err = SHARE_set_format(hit.share, format);
+  }
+  slots[0] = hit;
+  *share = hit.share;
+  return err;
+}
+
+// SHARE random number generator drawing from the sss_rng ctx
+static int share_rng(void *ctx, unsigned char *r, int len) {
+  rng_bytes((sss_rng *)ctx, r, (size_t)len);
+  return 0;
+}
+
+static void prime_split_items_task(void *arg, int t, size_t begin, size_t end) {
+  shares_job *job = (shares_job *)arg;
+  sss_rng rng;
+
+  pool_enter(&job->state->pool);
+  rng_fork(&job->state->rng, &rng);
+  pool_leave(&job->state->pool);
+
+  for (size_t i = begin; i < end; i++) {
+    split_item *item = &job->split[i];
+    SHARE *share;
+    SHARE_ERR err;
+
+    err = share_slot_get(job->state, t, item->sz, job->k, job->format,
+                         &share);
+    if (err == NONE)
+      err = SHARE_set_random(share, share_rng, &rng);
+    if (err == NONE)
+      err = SHARE_split_init(share, (uint8_t *)item->secret);
+    // All the x coordinates at once
+    if (err == NONE)
+      err = SHARE_split_at_n(share, job->xs, job->n, item->rows);
+    if (share != NULL) {
+      SHARE_set_random(share, NULL, NULL);
+      if (SHARE_clear(share) != NONE)
+        err = FAILED;
+    }
+    item->ok = err == NONE;
+  }
+  rng_free(&rng);
+}
+
+// The polynomials live in the share objects
+static size_t prime_split_scratch(const split_item *items, size_t cnt,
+                                   int k) {
+  (void)items, (void)cnt, (void)k;
+  return 0;
+}
+
+static int prime_format_split_run(sss_state *state, split_item *items,
+                                   size_t cnt, int n, int k,
+                                   const uint16_t *xs, SHARE_FORMAT format) {
+  shares_job job = {.state = state, .split = items, .n = n,
+                    .k = k, .xs = xs, .format = format};
+
+  if (!share_slots_init(state))
+    return 0;
+  pool_run(&state->pool, prime_split_items_task, &job, cnt, PRIME_GRAIN_ITEMS);
+  return 1;
+}
+
+static int prime_split_run(sss_state *state, split_item *items, size_t cnt,
+                            int n, int k, const uint16_t *xs) {
+  return prime_format_split_run(state, items, cnt, n, k, xs,
+                                SHARE_FORMAT_FULL);
+}
+
+static int prime_compact_split_run(sss_state *state, split_item *items,
+                                    size_t cnt, int n, int k,
+                                    const uint16_t *xs) {
+  return prime_format_split_run(state, items, cnt, n, k, xs,
+                                SHARE_FORMAT_COMPACT);
+}
+
+// Join the item with the share object
+static SHARE_ERR prime_join_item_run(sss_state *state, SHARE *share,
+                                     SHARE_FORMAT format, join_item *item) {
+  const uint8_t *const *rows = (const uint8_t *const *)item->rows;
   SHARE_ERR err;
-  SHARE *share = NULL;
-  uint8_t **split = NULL;
+  /* Weights of the x ordinates, the start of each share. */
+  uint16_t x_len = prime_x_len(item->size);
+  uint16_t w_len = x_len;
+  uint8_t weights[SHARE_PARTS_MAX * sizeof(prime_256)];
+  int i, hit;
 
-  err = SHARE_new(sz * 8, k, &share);
-  if (err == NONE) {
-    uint16_t len;
+  if (format == SHARE_FORMAT_COMPACT) {
+    x_len = PRIME_COMPACT_X_LEN;
+    w_len = prime_compact_len(item->size);
+  }
+  err = SHARE_join_init(share);
+  for (i = 0; err == NONE && i < item->n; i++)
+    err = SHARE_join_update(share, item->rows[i]);
+  if (err != NONE)
+    return err;
 
-    /* Get the length of the encoded data. */
-    err = SHARE_get_len(share, &len);
+  pool_enter(&state->pool);
+  hit = weights_cache_get(&state->cache, w_len, item->n, x_len, rows, w_len,
+                          weights);
+  pool_leave(&state->pool);
+  if (!hit) {
+    err = SHARE_join_weights(share, weights);
     if (err != NONE)
-      goto end;
+      return err;
+    pool_enter(&state->pool);
+    weights_cache_put(&state->cache, w_len, item->n, x_len, rows, w_len,
+                      weights);
+    pool_leave(&state->pool);
+  }
+  return SHARE_join_final_weights(share, weights, item->secret);
+}
+
+static void prime_join_items_task(void *arg, int t, size_t begin, size_t end) {
+  shares_job *job = (shares_job *)arg;
+
+  for (size_t i = begin; i < end; i++) {
+    join_item *item = &job->join[i];
+    size_t len = job->format == SHARE_FORMAT_COMPACT
+                     ? prime_compact_secret_len(item->size)
+                     : prime_secret_len(item->size);
+    SHARE *share = NULL;
+    SHARE_ERR err = PARAM_BAD_VALUE;
+
+    // The shares are the parts of the share object
+    if (item->n <= SHARE_PARTS_MAX)
+      err = share_slot_get(job->state, t, len, item->n, job->format, &share);
+    if (err == NONE)
+      err = prime_join_item_run(job->state, share, job->format, item);
+    if (share != NULL && SHARE_clear(share) != NONE)
+      err = FAILED;
+    item->ok = err == NONE;
+  }
+}
+
+static void prime_format_join_run(sss_state *state, join_item *items,
+                                  size_t cnt, SHARE_FORMAT format) {
+  shares_job job = {.state = state, .join = items, .format = format};
+
+  if (!share_slots_init(state)) {
+    for (size_t i = 0; i < cnt; i++)
+      items[i].ok = 0;
+    return;
+  }
+  pool_run(&state->pool, prime_join_items_task, &job, cnt, PRIME_GRAIN_ITEMS);
+}
+
+static void prime_join_run(sss_state *state, join_item *items, size_t cnt) {
+  prime_format_join_run(state, items, cnt, SHARE_FORMAT_FULL);
+}
+
+static void prime_compact_join_run(sss_state *state, join_item *items,
+                                   size_t cnt) {
+  prime_format_join_run(state, items, cnt, SHARE_FORMAT_COMPACT);
+}
+
+// A field the secrets are split in, each with its own share format
+typedef struct shares_backend_st {
+  const char *name;
+  // Largest x coordinate of a share, and so number of shares
+  int x_max;
+  // Largest threshold
+  int k_max;
+  // Length of each share of a secret of sz bytes, 0 when not supported
+  size_t (*row_len)(size_t sz);
+  // Length of the secret recovered from shares of size bytes
+  size_t (*secret_len)(size_t size);
+  // Arena space split_run takes for the cnt secrets
+  size_t (*split_scratch)(const split_item *items, size_t cnt, int k);
+  // Split the cnt secrets into n shares at the xs with a threshold of k.
+  // Returns 0 when out of memory.
+  int (*split_run)(sss_state *state, split_item *items, size_t cnt, int n,
+                   int k, const uint16_t *xs);
+  // Recover the secrets of the cnt items
+  void (*join_run)(sss_state *state, join_item *items, size_t cnt);
+} shares_backend;
+
+static const shares_backend SHARES_BACKENDS[] = {
+    {"gf256", GF_X_MAX, GF_X_MAX, gf_row_len, gf_secret_len,
+     gf_split_scratch, gf_split_run, gf_join_run},
+    {"prime", PRIME_X_MAX, SHARE_PARTS_MAX, prime_row_len, prime_secret_len,
+     prime_split_scratch, prime_split_run, prime_join_run},
+    {"prime_compact", PRIME_X_MAX, SHARE_PARTS_MAX, prime_compact_row_len,
+     prime_compact_secret_len, prime_split_scratch, prime_compact_split_run,
+     prime_compact_join_run},
+    {"gf65536", GF65536_X_MAX, GF65536_X_MAX, gf65536_row_len,
+     gf65536_secret_len, gf65536_split_scratch, gf65536_split_run,
+     gf65536_join_run},
+};
+
+#define SHARES_BACKENDS_NUM                                                    \
+  ((int)(sizeof(SHARES_BACKENDS) / sizeof(*SHARES_BACKENDS)))
+
+// The backend of the module built with USE_OPENSSL is the prime field, as
+// it used to be the only one compiled in
+#if defined(USE_OPENSSL)
+#define SHARES_BACKEND_DEFAULT 1
+#else
+#define SHARES_BACKEND_DEFAULT 0
+#endif
+
+// The backend of the name, NULL when unknown
+static const shares_backend *shares_backend_find(const char *name) {
+  for (int i = 0; i < SHARES_BACKENDS_NUM; i++) {
+    if (strcmp(name, SHARES_BACKENDS[i].name) == 0)
+      return &SHARES_BACKENDS[i];
+  }
+  return NULL;
+}
 
-    split = malloc(n * sizeof(*split));
-    if (split == NULL)
-      goto end;
+// The rows and the x coordinates of the n shares of a call, in the buffer,
+// either may be NULL. Returns 0 when out of memory.
+static int shares_buffer_reserve(sss_buffer *buf, int n, uint8_t ***rows,
+                                 uint16_t **xs) {
+  size_t rows_len = (size_t)n * sizeof(uint8_t *);
 
-    memset(split, 0, n * sizeof(*split));
-    for (k = 0; k < n; k++) {
-      split[k] = malloc(len);
-      if (split[k] == NULL)
-        goto end;
+  if (!buffer_reserve(buf, rows_len + n * sizeof(uint16_t)))
+    return 0;
+  if (rows != NULL)
+    *rows = (uint8_t **)buf->data;
+  if (xs != NULL)
+    *xs = (uint16_t *)(buf->data + rows_len);
+  return 1;
+}
+
+// The rows and the x coordinates of the n shares of a call, in the shares
+// buffer of the state
+static int shares_reserve(sss_state *state, int n, uint8_t ***rows,
+                          uint16_t **xs) {
+  return shares_buffer_reserve(&state->shares, n, rows, xs);
+}
+
+// Check the number of shares and the threshold at idx and idx + 1 against
+// the limits of the backend
+static void check_threshold(lua_State *L, int idx,
+                            const shares_backend *backend, int *n, int *k) {
+  lua_Integer shares = luaL_checkinteger(L, idx);
+  lua_Integer threshold = luaL_checkinteger(L, idx + 1);
+
+  luaL_argcheck(L, shares <= backend->x_max, idx, "out of range");
+  luaL_argcheck(L,
+                shares >= threshold && threshold > 1 &&
+                    threshold <= backend->k_max,
+                idx + 1, "out of range");
+  *n = (int)shares;
+  *k = (int)threshold;
+}
+
+// The backend named by options.backend of the options table at idx, the
+// default one of the state otherwise
+static const shares_backend *check_backend(lua_State *L, int idx) {
+  const shares_backend *backend = sss_state_get(L)->backend;
+
+  if (lua_istable(L, idx)) {
+    lua_getfield(L, idx, "backend");
+    if (!lua_isnil(L, -1)) {
+      backend = shares_backend_find(luaL_checkstring(L, -1));
+      luaL_argcheck(L, backend != NULL, idx, "unknown backend");
     }
+    lua_pop(L, 1);
+  }
+  return backend;
+}
 
-    /* Split */
-    err = SHARE_split_init(share, (uint8_t*)secret);
-    if (err != NONE)
-      goto end;
+// The length of the shares of a secret of sz bytes, checked to be supported
+static size_t check_row_len(lua_State *L, int idx,
+                            const shares_backend *backend, size_t sz) {
+  size_t row_len = backend->row_len(sz);
 
-    for (k = 0; err == NONE && k < n; k++)
-      err = SHARE_split(share, split[k]);
-    if (err != NONE)
-      goto end;
+  luaL_argcheck(L, row_len > 0, idx, "unsupported secret length");
+  return row_len;
+}
+
+// Whether the field name of the options table at idx is set
+static int check_option_flag(lua_State *L, int idx, const char *name) {
+  int flag;
+
+  if (lua_isnoneornil(L, idx))
+    return 0;
+  luaL_checktype(L, idx, LUA_TTABLE);
+  lua_getfield(L, idx, name);
+  flag = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+  return flag;
+}
+
+// The x coordinates of the n shares: the array xs of the options table at
+// idx, of distinct values from 1 to x_max, or 1 to n by default
+static void check_xs(lua_State *L, int idx, int x_max, int n, uint16_t *xs) {
+  if (!lua_isnoneornil(L, idx)) {
+    luaL_checktype(L, idx, LUA_TTABLE);
+    lua_getfield(L, idx, "xs");
+  } else {
+    lua_pushnil(L);
+  }
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    for (int i = 0; i < n; i++)
+      xs[i] = (uint16_t)(i + 1);
+    return;
+  }
+
+  luaL_argcheck(L, lua_istable(L, -1), idx, "xs must be a table");
+  luaL_argcheck(L, (int)lua_objlen(L, -1) == n, idx, "xs must hold n values");
+  // The x coordinates seen so far, one bit each
+  uint8_t seen[65536 / 8];
+  memset(seen, 0, sizeof(seen));
+  for (int i = 0; i < n; i++) {
+    lua_Integer x;
+    lua_rawgeti(L, -1, i + 1);
+    x = luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+    luaL_argcheck(L, x >= 1 && x <= x_max, idx, "x out of range");
+    xs[i] = (uint16_t)x;
+    luaL_argcheck(L, !(seen[x >> 3] & (1 << (x & 7))), idx, "duplicate x");
+    seen[x >> 3] |= (uint8_t)(1 << (x & 7));
+  }
+  lua_pop(L, 1);
+}
+
+// Collect the shares of the table or share set at idx into rows, checking
+// they have the same length. Only checks them when rows is NULL. Returns the
+// number of shares.
+static int check_shares(lua_State *L, int idx, const shares_backend *backend,
+                        uint8_t **rows, size_t *size) {
+  sss_shareset *set = (sss_shareset *)sss_testudata(L, idx, SSS_SHARESET_MT);
+  int n;
+
+  if (set != NULL) {
+    n = set->n;
+    luaL_argcheck(L, n > 0, idx, "empty share set");
+    luaL_argcheck(L, n <= backend->x_max, idx, "too many shares");
+    for (int i = 0; rows != NULL && i < n; i++)
+      rows[i] = shareset_row(set, i);
+    *size = set->row_len;
+  } else {
+    luaL_checktype(L, idx, LUA_TTABLE);
+    n = lua_objlen(L, idx);
+    luaL_argcheck(L, n > 0, idx, "empty table");
+    luaL_argcheck(L, n <= backend->x_max, idx, "too many shares");
 
-    lua_newtable(L);
-    for (k = 0; k < n; k++) {
-      lua_pushlstring(L, (const char *)split[k], len);
-      lua_rawseti(L, -2, k + 1);
-      free(split[k]);
+    for (int i = 0; i < n; i++) {
+      size_t sz;
+      const uint8_t *row;
+      lua_rawgeti(L, idx, i + 1);
+      row = sss_checkbytes(L, -1, &sz);
+      lua_pop(L, 1);
+      if (rows != NULL)
+        rows[i] = (uint8_t *)row;
+      if (i == 0)
+        *size = sz;
+      else
+        luaL_argcheck(L, *size == sz, idx, "partial secret length mismatch");
     }
-end:
-    free(split);
-    SHARE_free(share);
-    return err == NONE ? 1 : 0;
   }
-#endif
-  return 0;
+  luaL_argcheck(L,
+                *size > 1 &&
+                    backend->row_len(backend->secret_len(*size)) == *size,
+                idx, "invalid partial secret length");
+  return n;
 }
 
-static int combine_shares(lua_State *L) {
-  uint8_t n, i;
-  int size = 0;
-  uint8_t *restored;
-  uint8_t **shares;
+#include "sss_stream.c"
 
-  luaL_checktype(L, 1, LUA_TTABLE);
-  n = lua_objlen(L, 1);
-  luaL_argcheck(L, n > 0, 1, "empty table");
+// Push the n rows of row_len bytes as a table of strings
+static void push_rows(lua_State *L, uint8_t *const *rows, int n,
+                      size_t row_len) {
+  lua_createtable(L, n, 0);
+  for (int i = 0; i < n; i++) {
+    lua_pushlstring(L, (const char *)rows[i], row_len);
+    lua_rawseti(L, -2, i + 1);
+  }
+}
 
-#if !defined(USE_OPENSSL)
-  shares = (uint8_t **)malloc(n * sizeof(void *));
-  for (i = 0; i < n; i++) {
-    size_t sz;
-    lua_rawgeti(L, 1, i + 1);
-    shares[i] = (uint8_t *)luaL_checklstring(L, -1, &sz);
+// sss.create(secret, n, k [, options]) returns a table of n shares, or a
+// share set when options.set is true. The shares have the x coordinates
+// 1 to n, or those of the array options.xs. options.backend names the field,
+// "gf256", "prime", "prime_compact" or "gf65536", the default one otherwise.
+static int create_shares(lua_State *L) {
+  sss_state *state = sss_state_get(L);
+  const shares_backend *backend = check_backend(L, 4);
+  split_item item;
+  uint8_t **rows;
+  uint16_t *xs;
+  size_t row_len, out_len;
+  int n, k, as_set, ok;
+
+  memset(&item, 0, sizeof(item));
+  item.secret = sss_checkbytes(L, 1, &item.sz);
+  check_threshold(L, 2, backend, &n, &k);
+  row_len = check_row_len(L, 1, backend, item.sz);
+  as_set = check_option_flag(L, 4, "set");
+  if (!shares_reserve(state, n, &rows, &xs))
+    return luaL_error(L, "not enough memory");
+  item.rows = rows;
+  check_xs(L, 4, backend->x_max, n, xs);
+
+  out_len = as_set ? 0 : ARENA_SIZE(n * row_len);
+  if (!arena_begin(&state->arena,
+                   out_len + backend->split_scratch(&item, 1, k)))
+    return 0;
+  if (as_set) {
+    sss_shareset *set = shareset_new(L, n, row_len);
+    for (int i = 0; i < n; i++)
+      rows[i] = shareset_row(set, i);
+  } else {
+    uint8_t *out = (uint8_t *)arena_alloc(&state->arena, out_len);
+    for (int i = 0; i < n; i++)
+      rows[i] = out + i * row_len;
+  }
+
+  ok = backend->split_run(state, &item, 1, n, k, xs) && item.ok;
+  if (ok && !as_set)
+    push_rows(L, rows, n, row_len);
+  arena_end(&state->arena);
+  return ok;
+}
+
+// sss.create_many(secrets, n, k [, options]) splits every secret of the
+// array, or the secrets of options.len bytes the string or buffer is made
+// of, and returns an array of their shares
+static int create_many(lua_State *L) {
+  sss_state *state = sss_state_get(L);
+  const shares_backend *backend = check_backend(L, 4);
+  const uint8_t *data = NULL;
+  size_t sz = 0, total = 0, cnt, out_len = 0;
+  split_item *items;
+  uint8_t **rows;
+  uint16_t *xs;
+  int n, k, as_set, ok;
+
+  check_threshold(L, 2, backend, &n, &k);
+  as_set = check_option_flag(L, 4, "set");
+  if (!shares_reserve(state, n, NULL, &xs))
+    return luaL_error(L, "not enough memory");
+  check_xs(L, 4, backend->x_max, n, xs);
+
+  if (lua_istable(L, 1)) {
+    cnt = lua_objlen(L, 1);
+    for (size_t i = 1; i <= cnt; i++) {
+      lua_rawgeti(L, 1, i);
+      sss_checkbytes(L, -1, &sz);
+      out_len += n * check_row_len(L, 1, backend, sz);
+      total += sz;
+      lua_pop(L, 1);
+    }
+  } else {
+    lua_Integer len;
+
+    data = sss_checkbytes(L, 1, &total);
+    luaL_checktype(L, 4, LUA_TTABLE);
+    lua_getfield(L, 4, "len");
+    len = luaL_optinteger(L, -1, 0);
     lua_pop(L, 1);
-    if (i == 0)
-      size = sz;
-    else
-      luaL_argcheck(L, size == sz, 1, "partial secret length mismatch");
+    luaL_argcheck(L, len > 0, 4, "len must be positive");
+    sz = (size_t)len;
+    check_row_len(L, 4, backend, sz);
+    luaL_argcheck(L, total % sz == 0, 1, "length not a multiple of len");
+    cnt = total / sz;
+    out_len = cnt * n * backend->row_len(sz);
+  }
+
+  if (!buffer_reserve(&state->items,
+                      cnt * (sizeof(split_item) + n * sizeof(uint8_t *))))
+    return 0;
+  items = (split_item *)state->items.data;
+  rows = (uint8_t **)(items + cnt);
+
+  lua_createtable(L, (int)cnt, 0);
+  for (size_t i = 0; i < cnt; i++) {
+    split_item *item = &items[i];
+    memset(item, 0, sizeof(*item));
+    item->secret = data + i * sz;
+    item->sz = sz;
+    if (data == NULL) {
+      lua_rawgeti(L, 1, i + 1);
+      item->secret = sss_checkbytes(L, -1, &item->sz);
+      lua_pop(L, 1);
+    }
+    item->rows = rows + i * n;
+
+    if (as_set) {
+      sss_shareset *set = shareset_new(L, n, backend->row_len(item->sz));
+      lua_rawseti(L, -2, i + 1);
+      for (int j = 0; j < n; j++)
+        item->rows[j] = shareset_row(set, j);
+    }
+  }
+
+  if (as_set)
+    out_len = 0;
+  if (!arena_begin(&state->arena, ARENA_SIZE(out_len) +
+                                      backend->split_scratch(items, cnt, k)))
+    return 0;
+  if (!as_set) {
+    uint8_t *out = (uint8_t *)arena_alloc(&state->arena, out_len);
+    for (size_t i = 0; i < cnt; i++) {
+      size_t row_len = backend->row_len(items[i].sz);
+      for (int j = 0; j < n; j++, out += row_len)
+        items[i].rows[j] = out;
+    }
+  }
+
+  ok = backend->split_run(state, items, cnt, n, k, xs);
+  for (size_t i = 0; ok && i < cnt; i++) {
+    ok = items[i].ok;
+    if (ok && !as_set) {
+      push_rows(L, items[i].rows, n, backend->row_len(items[i].sz));
+      lua_rawseti(L, -2, i + 1);
+    }
+  }
+  arena_end(&state->arena);
+  return ok;
+}
+
+// sss.create_into(secret, n, k, buffers [, options]) writes the n shares
+// into the buffers of the table, resizing them as needed
+static int create_into(lua_State *L) {
+  sss_state *state = sss_state_get(L);
+  const shares_backend *backend = check_backend(L, 5);
+  split_item item;
+  uint8_t **rows;
+  uint16_t *xs;
+  size_t row_len;
+  int n, k, ok;
+
+  memset(&item, 0, sizeof(item));
+  item.secret = sss_checkbytes(L, 1, &item.sz);
+  check_threshold(L, 2, backend, &n, &k);
+  row_len = check_row_len(L, 1, backend, item.sz);
+  if (!shares_reserve(state, n, &rows, &xs))
+    return luaL_error(L, "not enough memory");
+  item.rows = rows;
+  check_xs(L, 5, backend->x_max, n, xs);
+  luaL_checktype(L, 4, LUA_TTABLE);
+  for (int i = 0; i < n; i++) {
+    lua_rawgeti(L, 4, i + 1);
+    sss_buffer *buf = (sss_buffer *)sss_testudata(L, -1, SSS_BUFFER_MT);
+    luaL_argcheck(L, buf != NULL, 4, "buffer expected for every share");
+    luaL_argcheck(L, buf->data == NULL || buf->data != item.secret, 4,
+                  "buffer is the secret");
+    lua_pop(L, 1);
+    if (!buffer_resize(buf, row_len))
+      return luaL_error(L, "not enough memory");
+    rows[i] = buf->data;
   }
-  restored = join(shares, size, n);
-  if (restored != NULL)
-    lua_pushlstring(L, (const char *)restored, size - 1);
+
+  if (!arena_begin(&state->arena, backend->split_scratch(&item, 1, k)))
+    return 0;
+  ok = backend->split_run(state, &item, 1, n, k, xs) && item.ok;
+  arena_end(&state->arena);
+  if (!ok)
+    return 0;
+  lua_settop(L, 4);
+  return 1;
+}
+
+// sss.combine(shares [, options]) returns the secret of the table or share
+// set of shares in the field of options.backend, nil when it can't be
+// recovered
+static int combine_shares(lua_State *L) {
+  sss_state *state = sss_state_get(L);
+  const shares_backend *backend = check_backend(L, 2);
+  join_item item;
+  size_t len;
+
+  memset(&item, 0, sizeof(item));
+  item.n = check_shares(L, 1, backend, NULL, &item.size);
+  if (!shares_reserve(state, item.n, &item.rows, NULL))
+    return luaL_error(L, "not enough memory");
+  check_shares(L, 1, backend, item.rows, &item.size);
+  len = backend->secret_len(item.size);
+  if (!arena_begin(&state->arena, ARENA_SIZE(len + 1))) {
+    lua_pushnil(L);
+    return 1;
+  }
+  item.secret = (uint8_t *)arena_alloc(&state->arena, len + 1);
+
+  backend->join_run(state, &item, 1);
+  if (item.ok)
+    lua_pushlstring(L, (const char *)item.secret, len);
   else
     lua_pushnil(L);
+  arena_end(&state->arena);
+  return 1;
+}
 
-  free(shares);
-  free(restored);
-  n = 1;
-#else
-  SHARE_ERR err;
-  SHARE *share = NULL;
-  int len = 0;
+// sss.combine_many(list [, options]) combines every table or share set of
+// the array and returns the array of secrets, false for those that can't be
+// recovered
+static int combine_many(lua_State *L) {
+  sss_state *state = sss_state_get(L);
+  const shares_backend *backend = check_backend(L, 2);
+  size_t cnt, nrows = 0, out_len = 0;
+  join_item *items;
+  uint8_t **rows, *out;
+
+  luaL_checktype(L, 1, LUA_TTABLE);
+  cnt = lua_objlen(L, 1);
+  lua_settop(L, 1);
+
+  for (size_t i = 1; i <= cnt; i++) {
+    size_t size;
+    lua_rawgeti(L, 1, i);
+    nrows += check_shares(L, 2, backend, NULL, &size);
+    out_len += backend->secret_len(size);
+    lua_pop(L, 1);
+  }
 
-  shares = (uint8_t **)malloc(n * sizeof(void *));
-  for (i = 0; i < n; i++) {
-    size_t sz;
+  if (!buffer_reserve(&state->items,
+                      cnt * sizeof(join_item) + nrows * sizeof(uint8_t *)) ||
+      !arena_begin(&state->arena, ARENA_SIZE(out_len + 1)))
+    return 0;
+  items = (join_item *)state->items.data;
+  rows = (uint8_t **)(items + cnt);
+  out = (uint8_t *)arena_alloc(&state->arena, out_len + 1);
+
+  for (size_t i = 0, off = 0; i < cnt; i++) {
+    join_item *item = &items[i];
+    memset(item, 0, sizeof(*item));
+    item->rows = rows;
     lua_rawgeti(L, 1, i + 1);
-    shares[i] = (uint8_t *)luaL_checklstring(L, -1, &sz);
+    item->n = check_shares(L, 2, backend, rows, &item->size);
     lua_pop(L, 1);
-    if (i == 0)
-      size = sz;
+    item->secret = out + off;
+    off += backend->secret_len(item->size);
+    rows += item->n;
+  }
+
+  backend->join_run(state, items, cnt);
+
+  lua_createtable(L, (int)cnt, 0);
+  for (size_t i = 0; i < cnt; i++) {
+    if (items[i].ok)
+      lua_pushlstring(L, (const char *)items[i].secret,
+                      backend->secret_len(items[i].size));
     else
-      luaL_argcheck(L, size == sz, 1, "partial secret length mismatch");
+      lua_pushboolean(L, 0);
+    lua_rawseti(L, -2, i + 1);
   }
-  len = (size - 2) / 2;
+  arena_end(&state->arena);
+  return 1;
+}
 
-  err = SHARE_new(len * 8, n, &share);
-  if (err == NONE) {
-    err = SHARE_join_init(share);
-    if (err != NONE)
-      goto end;
+// sss.combine_into(shares, buffer [, options]) writes the secret into the
+// buffer, resizing it as needed
+static int combine_into(lua_State *L) {
+  sss_state *state = sss_state_get(L);
+  const shares_backend *backend = check_backend(L, 3);
+  join_item item;
+  sss_buffer *buf;
 
-    for (i = 0; err == NONE && i < n; i++) {
-      err = SHARE_join_update(share, shares[i]);
-    }
+  memset(&item, 0, sizeof(item));
+  item.n = check_shares(L, 1, backend, NULL, &item.size);
+  if (!shares_reserve(state, item.n, &item.rows, NULL))
+    return luaL_error(L, "not enough memory");
+  check_shares(L, 1, backend, item.rows, &item.size);
+  buf = buffer_check(L, 2);
+  for (int i = 0; i < item.n; i++)
+    luaL_argcheck(L, buf->data == NULL || buf->data != item.rows[i], 2,
+                  "buffer is one of the shares");
+  if (!buffer_resize(buf, backend->secret_len(item.size)))
+    return luaL_error(L, "not enough memory");
+  item.secret = buf->data;
 
-    if (err == NONE) {
-      restored = malloc(size);
-      err = SHARE_join_final(share, restored);
-      if (err == NONE)
-      {
-        lua_pushlstring(L, (const char *)restored, len);
-        n = 1;
-      }
-      free(restored);
-    }
-  }
+  backend->join_run(state, &item, 1);
+  if (!item.ok)
+    lua_pushnil(L);
   else
-    n = 0;
-end:
-  free(shares);
-  SHARE_free(share);
-#endif
-  return n;
+    lua_settop(L, 2);
+  return 1;
+}
+
+// sss.set_threads(n) runs the splits and joins of large secrets and batches
+// on n threads. Returns the number of threads in use.
+static int set_threads(lua_State *L) {
+  sss_state *state = sss_state_get(L);
+  lua_Integer n = luaL_checkinteger(L, 1);
+
+  luaL_argcheck(L, n >= 1, 1, "out of range");
+  lua_pushinteger(L, pool_resize(&state->pool, (int)n));
+  return 1;
 }
 
+#include "sss_async.c"
+#include "sss_context.c"
+
 static int generate_random(lua_State *L) {
-  int n = luaL_checkinteger(L, 1);
-  uint8_t *buf = (uint8_t *)malloc(n);
+  sss_state *state = sss_state_get(L);
+  lua_Integer n = luaL_checkinteger(L, 1);
 
-#if !defined(USE_OPENSSL)
-  int i;
-  for (i = 0; i < n; i++) {
-    buf[i] = rand_byte();
+  uint8_t *out;
+
+  luaL_argcheck(L, n >= 0, 1, "out of range");
+  if (!arena_begin(&state->arena, ARENA_SIZE((size_t)n + 1)))
+    return luaL_error(L, "not enough memory");
+  out = (uint8_t *)arena_alloc(&state->arena, (size_t)n + 1);
+  rng_bytes(&state->rng, out, (size_t)n);
+  lua_pushlstring(L, (const char *)out, (size_t)n);
+  arena_end(&state->arena);
+  return 1;
+}
+
+// sss.backend([name]) sets the field of the splits and joins not given one,
+// "gf256", "prime", "prime_compact" or "gf65536". Returns the name of the
+// default backend.
+static int select_backend(lua_State *L) {
+  sss_state *state = sss_state_get(L);
+
+  if (!lua_isnoneornil(L, 1)) {
+    const shares_backend *backend = shares_backend_find(luaL_checkstring(L, 1));
+
+    luaL_argcheck(L, backend != NULL, 1, "unknown backend");
+    state->backend = backend;
   }
-#else
-  SHARE_random(buf, n);
-#endif
+  lua_pushstring(L, state->backend->name);
+  return 1;
+}
 
-  lua_pushlstring(L, (const char *)buf, n);
-  free(buf);
+// sss.prime_impl([name]) sets the implementation of the prime field
+// arithmetic, "Native", "OpenSSL Montgomery" or "OpenSSL Generic", false for
+// the first that supports the secret. The implementations give the same
+// shares; this is for testing and comparing them, so the weights cached
+// are dropped too. Returns the name set, nil for the default.
+static int select_prime_impl(lua_State *L) {
+  sss_state *state = sss_state_get(L);
+
+  if (!lua_isnone(L, 1) && !lua_toboolean(L, 1)) {
+    share_slots_free(state);
+    weights_cache_free(&state->cache);
+    state->prime_impl[0] = '\0';
+  } else if (!lua_isnone(L, 1)) {
+    size_t len;
+    const char *name = luaL_checklstring(L, 1, &len);
+    SHARE *share = NULL;
+
+    // Any implementation supports 128 bits when it supports one length
+    luaL_argcheck(L, len < sizeof(state->prime_impl) &&
+                         SHARE_new_impl(128, 2, name, &share) == NONE,
+                  1, "unknown implementation");
+    SHARE_free(share);
+    share_slots_free(state);
+    weights_cache_free(&state->cache);
+    memcpy(state->prime_impl, name, len + 1);
+  }
+  if (prime_impl_name(state) != NULL)
+    lua_pushstring(L, state->prime_impl);
+  else
+    lua_pushnil(L);
   return 1;
 }
 
-LUALIB_API int luaopen_sss(lua_State *L) {
-#if !defined(USE_OPENSSL)
-  srand(time(NULL));
-#endif
+// sss.engine([name]) sets the GF(2 ^ 8) kernel of the state. Returns the
+// name of the kernel.
+static int select_engine(lua_State *L) {
+  sss_state *state = sss_state_get(L);
+
+  if (!lua_isnoneornil(L, 1)) {
+    const char *name = luaL_checkstring(L, 1);
+    int i;
+
+    for (i = 0; i < P_DOT_ENGINES_NUM; i++) {
+      if (strcmp(name, P_DOT_ENGINES[i].name) == 0)
+        break;
+    }
+    luaL_argcheck(L, i < P_DOT_ENGINES_NUM, 1, "unknown engine");
+    luaL_argcheck(L, P_DOT_ENGINES[i].available, 1,
+                  "engine not supported by this CPU");
+    state->engine = i;
+  }
+  lua_pushstring(L, P_DOT_ENGINES[state->engine].name);
+  return 1;
+}
+
+static int cache_stats(lua_State *L) {
+  sss_state *state = sss_state_get(L);
+  int entries = 0;
+
+  for (int e = 0; e < WEIGHTS_CACHE_SIZE; e++)
+    entries += state->cache.entries[e].used != 0;
 
   lua_newtable(L);
+  lua_pushnumber(L, (lua_Number)state->cache.hits);
+  lua_setfield(L, -2, "hits");
+  lua_pushnumber(L, (lua_Number)state->cache.misses);
+  lua_setfield(L, -2, "misses");
+  lua_pushinteger(L, entries);
+  lua_setfield(L, -2, "entries");
+  return 1;
+}
 
-  lua_pushliteral(L, "create");
-  lua_pushcfunction(L, create_shares);
-  lua_rawset(L, -3);
+static const luaL_Reg sss_functions[] = {
+    {"create", create_shares},
+    {"combine", combine_shares},
+    {"create_many", create_many},
+    {"combine_many", combine_many},
+    {"create_into", create_into},
+    {"combine_into", combine_into},
+    {"create_async", create_async},
+    {"combine_async", combine_async},
+    {"buffer", buffer_new},
+    {"random", generate_random},
+    {"cache_stats", cache_stats},
+    {"set_threads", set_threads},
+    {"backend", select_backend},
+    {"engine", select_engine},
+    {"prime_impl", select_prime_impl},
+    {"splitter", splitter_new},
+    {"joiner", joiner_new},
+    {"context", context_new},
+    {NULL, NULL}};
 
-  lua_pushliteral(L, "combine");
-  lua_pushcfunction(L, combine_shares);
-  lua_rawset(L, -3);
+LUALIB_API int luaopen_sss(lua_State *L) {
+  p_dot_select();
+  gf65536_init();
+
+  buffer_register(L);
+  shareset_register(L);
+  job_register(L);
+  stream_register(L);
+  context_register(L);
+  lua_newtable(L);
 
-  lua_pushliteral(L, "random");
-  lua_pushcfunction(L, generate_random);
-  lua_rawset(L, -3);
+  sss_state *state = (sss_state *)lua_newuserdata(L, sizeof(sss_state));
+  memset(state, 0, sizeof(*state));
+  pool_init(&state->pool);
+  state->backend = &SHARES_BACKENDS[SHARES_BACKEND_DEFAULT];
+  state->engine = p_dot_default;
+  if (luaL_newmetatable(L, SSS_STATE_MT)) {
+    lua_pushcfunction(L, sss_state_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  if (!rng_init(&state->rng))
+    return luaL_error(L, "no entropy available to seed the generator");
+
+  for (const luaL_Reg *f = sss_functions; f->name != NULL; f++) {
+    lua_pushstring(L, f->name);
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, f->func, 1);
+    lua_rawset(L, -4);
+  }
+  lua_pop(L, 1);
 
   return 1;
 }
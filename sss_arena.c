@@ -0,0 +1,116 @@
+/*
+ * Locked scratch memory for the temporaries of split and join.
+ *
+ * An arena is one block of memory handed out front to back during a call
+ * and wiped as a whole when the call is done. It only grows when a call
+ * needs more than any call before it, so in steady state the splits and
+ * joins of a Lua state do no heap allocation. Where the system allows it the
+ * block is locked in memory, so the random coefficients, shares and secrets
+ * kept there are never written to swap, and left out of core dumps. When the
+ * limit on locked memory is reached the arena works unlocked.
+ *
+ * This file is included by sss.c and must not be compiled on its own.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define ARENA_MLOCK
+#endif
+
+// Alignment of the allocations of an arena
+#define ARENA_ALIGN 16
+
+typedef struct sss_arena_st {
+  uint8_t *data;
+  // Allocated size of data
+  size_t cap;
+  // Bytes handed out since the start of the call
+  size_t used;
+  // Whether data is locked in memory
+  int locked;
+} sss_arena;
+
+// Wipe len bytes at p, even when the compiler can see they are not read
+// again
+static void sss_wipe(void *p, size_t len) {
+#if (defined(__GLIBC__) &&                                                     \
+     (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 25))) ||          \
+    defined(__OpenBSD__) || defined(__FreeBSD__) || defined(__NetBSD__)
+  explicit_bzero(p, len);
+#else
+  void *(*volatile wipe)(void *, int, size_t) = memset;
+  wipe(p, 0, len);
+#endif
+}
+
+static void arena_free(sss_arena *arena) {
+  if (arena->data != NULL) {
+    sss_wipe(arena->data, arena->cap);
+#if defined(ARENA_MLOCK)
+    if (arena->locked)
+      munlock(arena->data, arena->cap);
+#endif
+  }
+  free(arena->data);
+  arena->data = NULL;
+  arena->cap = arena->used = 0;
+  arena->locked = 0;
+}
+
+// Start a call needing up to len bytes, wiping what the last one left.
+// Returns 0 when out of memory.
+static int arena_begin(sss_arena *arena, size_t len) {
+  if (arena->used > 0)
+    sss_wipe(arena->data, arena->used);
+  arena->used = 0;
+  if (len <= arena->cap)
+    return 1;
+
+  size_t cap = arena->cap * 2 > len ? arena->cap * 2 : len;
+  void *data;
+#if defined(ARENA_MLOCK)
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  cap = (cap + page - 1) / page * page;
+  if (posix_memalign(&data, page, cap) != 0)
+    return 0;
+#else
+  data = malloc(cap);
+  if (data == NULL)
+    return 0;
+#endif
+
+  arena_free(arena);
+  arena->data = (uint8_t *)data;
+  arena->cap = cap;
+#if defined(ARENA_MLOCK)
+  arena->locked = mlock(data, cap) == 0;
+#if defined(MADV_DONTDUMP)
+  madvise(data, cap, MADV_DONTDUMP);
+#endif
+#endif
+  return 1;
+}
+
+// Size to pass to arena_begin for an allocation of len bytes
+#define ARENA_SIZE(len) (((len) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+// Hand out len bytes of the call. Returns NULL when arena_begin was given
+// less.
+static void *arena_alloc(sss_arena *arena, size_t len) {
+  size_t size = ARENA_SIZE(len);
+  void *p;
+
+  if (size > arena->cap - arena->used)
+    return NULL;
+  p = arena->data + arena->used;
+  arena->used += size;
+  return p;
+}
+
+// End the call, wiping all that was handed out
+static void arena_end(sss_arena *arena) {
+  if (arena->used > 0)
+    sss_wipe(arena->data, arena->used);
+  arena->used = 0;
+}
@@ -0,0 +1,319 @@
+/*
+ * Asynchronous create and combine.
+ *
+ * sss.create_async() and sss.combine_async() copy their arguments into a
+ * job and run the split or join on a thread of its own, then return the
+ * job at once. job:poll() tells whether the job is done, job:wait() blocks
+ * until it is and returns what sss.create() or sss.combine() would have,
+ * and job:await() yields the calling coroutine with the job until it is
+ * done on Lua 5.2 and later. A job has its own scratch memory, weights
+ * cache and random generator so the Lua state can go on using the module
+ * meanwhile. Without PTHREADS the work is done before the job is returned.
+ *
+ * This file is included by sss.c and must not be compiled on its own.
+ */
+
+#define SSS_JOB_MT "sss.job"
+
+enum { JOB_CREATE, JOB_COMBINE };
+
+typedef struct sss_job_st {
+  // State of the splits and joins of the job, apart from the Lua state's
+  sss_state work;
+  // JOB_CREATE or JOB_COMBINE
+  int kind;
+  // Field of the split or join
+  const shares_backend *backend;
+  // Number of shares and threshold
+  int n;
+  int k;
+  // Whether the shares are returned as a share set
+  int as_set;
+  // Length of each share
+  size_t row_len;
+  // The x coordinates of the shares to create, in the shares buffer of work
+  uint16_t *xs;
+  // Copy of the secret or the shares
+  sss_buffer in;
+  // The shares or the secret
+  sss_buffer out;
+  // The shares, in the shares buffer of work
+  uint8_t **rows;
+  split_item split;
+  join_item join;
+  // Whether the split or join succeeded
+  int ok;
+  // Whether the thread has to be joined
+  int running;
+  // Whether the work is done, under lock
+  int done;
+#if defined(PTHREADS)
+  pthread_t thread;
+  pthread_mutex_t lock;
+#endif
+} sss_job;
+
+#define job_check(L, idx) ((sss_job *)luaL_checkudata(L, idx, SSS_JOB_MT))
+
+static void job_work(sss_job *job) {
+  if (job->kind == JOB_CREATE) {
+    sss_arena *arena = &job->work.arena;
+    size_t scratch = job->backend->split_scratch(&job->split, 1, job->k);
+    job->ok = arena_begin(arena, scratch) &&
+              job->backend->split_run(&job->work, &job->split, 1, job->n,
+                                      job->k, job->xs) &&
+              job->split.ok;
+    arena_end(arena);
+  } else {
+    job->backend->join_run(&job->work, &job->join, 1);
+    job->ok = job->join.ok;
+  }
+}
+
+#if defined(PTHREADS)
+static void *job_main(void *arg) {
+  sss_job *job = (sss_job *)arg;
+
+  job_work(job);
+  pthread_mutex_lock(&job->lock);
+  job->done = 1;
+  pthread_mutex_unlock(&job->lock);
+  return NULL;
+}
+#endif
+
+// Push a new job of the kind, not started yet
+static sss_job *job_new(lua_State *L, int kind,
+                       const shares_backend *backend) {
+  sss_job *job = (sss_job *)lua_newuserdata(L, sizeof(sss_job));
+
+  memset(job, 0, sizeof(*job));
+  pool_init(&job->work.pool);
+  job->kind = kind;
+  job->backend = backend;
+  job->work.backend = backend;
+  memcpy(job->work.prime_impl, sss_state_get(L)->prime_impl,
+         sizeof(job->work.prime_impl));
+  job->work.engine = sss_state_get(L)->engine;
+#if defined(PTHREADS)
+  pthread_mutex_init(&job->lock, NULL);
+#endif
+  luaL_getmetatable(L, SSS_JOB_MT);
+  lua_setmetatable(L, -2);
+  return job;
+}
+
+// Run the job on a thread of its own, or right away when there is none
+static void job_start(sss_job *job) {
+#if defined(PTHREADS)
+  if (pthread_create(&job->thread, NULL, job_main, job) == 0) {
+    job->running = 1;
+    return;
+  }
+#endif
+  job_work(job);
+  job->done = 1;
+}
+
+// Wait for the thread of the job
+static void job_join(sss_job *job) {
+#if defined(PTHREADS)
+  if (job->running) {
+    pthread_join(job->thread, NULL);
+    job->running = 0;
+  }
+#else
+  (void)job;
+#endif
+}
+
+static int job_is_done(sss_job *job) {
+  int done;
+
+#if defined(PTHREADS)
+  pthread_mutex_lock(&job->lock);
+  done = job->done;
+  pthread_mutex_unlock(&job->lock);
+#else
+  done = job->done;
+#endif
+  return done;
+}
+
+// sss.create_async(secret, n, k [, options]) starts sss.create on a thread
+static int create_async(lua_State *L) {
+  const shares_backend *backend = check_backend(L, 4);
+  size_t sz, row_len;
+  const uint8_t *secret = sss_checkbytes(L, 1, &sz);
+  uint16_t *xs;
+  int n, k, as_set;
+  sss_job *job;
+
+  check_threshold(L, 2, backend, &n, &k);
+  row_len = check_row_len(L, 1, backend, sz);
+  as_set = check_option_flag(L, 4, "set");
+  if (!shares_reserve(sss_state_get(L), n, NULL, &xs))
+    return luaL_error(L, "not enough memory");
+  check_xs(L, 4, backend->x_max, n, xs);
+
+  job = job_new(L, JOB_CREATE, backend);
+  if (!shares_reserve(&job->work, n, &job->rows, &job->xs))
+    return luaL_error(L, "not enough memory");
+  rng_fork(&sss_state_get(L)->rng, &job->work.rng);
+  job->n = n;
+  job->k = k;
+  job->as_set = as_set;
+  job->row_len = row_len;
+  memcpy(job->xs, xs, n * sizeof(*xs));
+  if (!buffer_resize(&job->in, sz + 1) ||
+      !buffer_resize(&job->out, n * row_len))
+    return luaL_error(L, "not enough memory");
+  memcpy(job->in.data, secret, sz);
+  for (int i = 0; i < n; i++)
+    job->rows[i] = job->out.data + i * row_len;
+  job->split.secret = job->in.data;
+  job->split.sz = sz;
+  job->split.rows = job->rows;
+
+  job_start(job);
+  return 1;
+}
+
+// sss.combine_async(shares [, options]) starts sss.combine on a thread
+static int combine_async(lua_State *L) {
+  const shares_backend *backend = check_backend(L, 2);
+  uint8_t **rows;
+  size_t size;
+  int n = check_shares(L, 1, backend, NULL, &size);
+  sss_job *job;
+
+  if (!shares_reserve(sss_state_get(L), n, &rows, NULL))
+    return luaL_error(L, "not enough memory");
+  check_shares(L, 1, backend, rows, &size);
+  job = job_new(L, JOB_COMBINE, backend);
+  if (!shares_reserve(&job->work, n, &job->rows, NULL))
+    return luaL_error(L, "not enough memory");
+  job->n = n;
+  job->row_len = size;
+  if (!buffer_resize(&job->in, n * size) ||
+      !buffer_resize(&job->out, backend->secret_len(size) + 1))
+    return luaL_error(L, "not enough memory");
+  for (int i = 0; i < n; i++) {
+    job->rows[i] = job->in.data + i * size;
+    memcpy(job->rows[i], rows[i], size);
+  }
+  job->join.rows = job->rows;
+  job->join.size = size;
+  job->join.n = n;
+  job->join.secret = job->out.data;
+
+  job_start(job);
+  return 1;
+}
+
+// job:poll() returns whether the job is done
+static int job_poll(lua_State *L) {
+  lua_pushboolean(L, job_is_done(job_check(L, 1)));
+  return 1;
+}
+
+// job:wait() waits for the job and returns its results
+static int job_wait(lua_State *L) {
+  sss_job *job = job_check(L, 1);
+
+  job_join(job);
+  if (job->kind == JOB_COMBINE) {
+    if (job->ok)
+      lua_pushlstring(L, (const char *)job->out.data,
+                      job->backend->secret_len(job->row_len));
+    else
+      lua_pushnil(L);
+    return 1;
+  }
+
+  if (!job->ok)
+    return 0;
+  if (job->as_set) {
+    sss_shareset *set = shareset_new(L, job->n, job->row_len);
+    memcpy(set->data, job->out.data, job->n * job->row_len);
+  } else {
+    push_rows(L, job->rows, job->n, job->row_len);
+  }
+  return 1;
+}
+
+#if LUA_VERSION_NUM > 502
+static int job_await(lua_State *L);
+
+static int job_await_k(lua_State *L, int status, lua_KContext ctx) {
+  (void)status, (void)ctx;
+  return job_await(L);
+}
+#elif LUA_VERSION_NUM == 502
+static int job_await(lua_State *L);
+
+static int job_await_k(lua_State *L) { return job_await(L); }
+#endif
+
+// Whether the running coroutine can yield
+static int job_can_yield(lua_State *L) {
+#if LUA_VERSION_NUM > 502
+  return lua_isyieldable(L);
+#elif LUA_VERSION_NUM == 502
+  int main = lua_pushthread(L);
+  lua_pop(L, 1);
+  return !main;
+#else
+  (void)L;
+  return 0;
+#endif
+}
+
+// job:await() yields the job until it is done, then returns its results.
+// Blocks like job:wait() where the caller can't yield.
+static int job_await(lua_State *L) {
+  sss_job *job = job_check(L, 1);
+
+  if (job_is_done(job) || !job_can_yield(L))
+    return job_wait(L);
+#if LUA_VERSION_NUM >= 502
+  lua_settop(L, 1);
+  lua_pushvalue(L, 1);
+  return lua_yieldk(L, 1, 0, job_await_k);
+#else
+  return job_wait(L);
+#endif
+}
+
+static int job_gc(lua_State *L) {
+  sss_job *job = job_check(L, 1);
+
+  job_join(job);
+  sss_state_free(&job->work);
+  buffer_free(&job->in);
+  buffer_free(&job->out);
+  memset(job->join.coeffs, 0, sizeof(job->join.coeffs));
+#if defined(PTHREADS)
+  pthread_mutex_destroy(&job->lock);
+#endif
+  return 0;
+}
+
+static const luaL_Reg job_methods[] = {{"poll", job_poll},
+                                       {"wait", job_wait},
+                                       {"await", job_await},
+                                       {NULL, NULL}};
+
+static void job_register(lua_State *L) {
+  if (luaL_newmetatable(L, SSS_JOB_MT)) {
+    lua_pushcfunction(L, job_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_newtable(L);
+    for (const luaL_Reg *f = job_methods; f->name != NULL; f++) {
+      lua_pushcfunction(L, f->func);
+      lua_setfield(L, -2, f->name);
+    }
+    lua_setfield(L, -2, "__index");
+  }
+  lua_pop(L, 1);
+}
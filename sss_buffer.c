@@ -0,0 +1,176 @@
+/*
+ * Resizable byte buffers.
+ *
+ * A buffer only reallocates when it grows past its capacity, so a caller
+ * that passes the same buffers to sss.create_into() and sss.combine_into()
+ * over and over does no heap allocation in steady state and creates no
+ * garbage for the Lua collector. The module also keeps buffers of its own
+ * for temporaries.
+ *
+ * This file is included by sss.c and must not be compiled on its own.
+ */
+
+#define SSS_BUFFER_MT "sss.buffer"
+
+typedef struct sss_buffer_st {
+  uint8_t *data;
+  // Length of the contents
+  size_t len;
+  // Allocated size of data
+  size_t cap;
+} sss_buffer;
+
+// Make room for len bytes, keeping the contents. The old memory is wiped
+// before it is released, as realloc() would leave the contents in the heap.
+// Returns 0 when out of memory.
+static int buffer_reserve(sss_buffer *buf, size_t len) {
+  if (len > buf->cap) {
+    size_t cap = buf->cap * 2 > len ? buf->cap * 2 : len;
+    uint8_t *data = malloc(cap);
+    if (data == NULL)
+      return 0;
+    if (buf->data != NULL) {
+      memcpy(data, buf->data, buf->cap);
+      sss_wipe(buf->data, buf->cap);
+      free(buf->data);
+    }
+    buf->data = data;
+    buf->cap = cap;
+  }
+  return 1;
+}
+
+// Set the length of the contents. Returns 0 when out of memory.
+static int buffer_resize(sss_buffer *buf, size_t len) {
+  if (!buffer_reserve(buf, len))
+    return 0;
+  buf->len = len;
+  return 1;
+}
+
+// Wipe and release the memory of the buffer
+static void buffer_free(sss_buffer *buf) {
+  if (buf->data != NULL)
+    sss_wipe(buf->data, buf->cap);
+  free(buf->data);
+  buf->data = NULL;
+  buf->len = buf->cap = 0;
+}
+
+// The userdata at idx if its metatable is tname, NULL otherwise
+static void *sss_testudata(lua_State *L, int idx, const char *tname) {
+  void *p = lua_touserdata(L, idx);
+
+  if (p != NULL && lua_getmetatable(L, idx)) {
+    luaL_getmetatable(L, tname);
+    if (!lua_rawequal(L, -1, -2))
+      p = NULL;
+    lua_pop(L, 2);
+    return p;
+  }
+  return NULL;
+}
+
+#define buffer_check(L, idx)                                                   \
+  ((sss_buffer *)luaL_checkudata(L, idx, SSS_BUFFER_MT))
+
+// The bytes of a string or buffer argument
+static const uint8_t *sss_checkbytes(lua_State *L, int idx, size_t *len) {
+  sss_buffer *buf = (sss_buffer *)sss_testudata(L, idx, SSS_BUFFER_MT);
+
+  if (buf != NULL) {
+    *len = buf->len;
+    // A valid pointer even when nothing was ever allocated
+    return buf->data != NULL ? buf->data : (const uint8_t *)"";
+  }
+  return (const uint8_t *)luaL_checklstring(L, idx, len);
+}
+
+static int buffer_new(lua_State *L) {
+  lua_Integer len = luaL_optinteger(L, 1, 0);
+  sss_buffer *buf;
+
+  luaL_argcheck(L, len >= 0, 1, "out of range");
+  buf = (sss_buffer *)lua_newuserdata(L, sizeof(sss_buffer));
+  memset(buf, 0, sizeof(*buf));
+  luaL_getmetatable(L, SSS_BUFFER_MT);
+  lua_setmetatable(L, -2);
+  if (!buffer_resize(buf, (size_t)len))
+    return luaL_error(L, "not enough memory");
+  if (buf->len > 0)
+    memset(buf->data, 0, buf->len);
+  return 1;
+}
+
+static int buffer_gc(lua_State *L) {
+  buffer_free(buffer_check(L, 1));
+  return 0;
+}
+
+static int buffer_len(lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)buffer_check(L, 1)->len);
+  return 1;
+}
+
+static int buffer_capacity(lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)buffer_check(L, 1)->cap);
+  return 1;
+}
+
+// buf:resize(len) keeps the contents up to len, new bytes are zero
+static int buffer_resize_method(lua_State *L) {
+  sss_buffer *buf = buffer_check(L, 1);
+  lua_Integer len = luaL_checkinteger(L, 2);
+  size_t old = buf->len;
+
+  luaL_argcheck(L, len >= 0, 2, "out of range");
+  if (!buffer_resize(buf, (size_t)len))
+    return luaL_error(L, "not enough memory");
+  if (buf->len > old)
+    memset(buf->data + old, 0, buf->len - old);
+  lua_settop(L, 1);
+  return 1;
+}
+
+// buf:tostring([i [, j]]) copies the bytes i to j, like string.sub
+static int buffer_tostring(lua_State *L) {
+  sss_buffer *buf = buffer_check(L, 1);
+  lua_Integer len = (lua_Integer)buf->len;
+  lua_Integer i = luaL_optinteger(L, 2, 1);
+  lua_Integer j = luaL_optinteger(L, 3, -1);
+
+  if (i < 0)
+    i = i + len + 1 > 0 ? i + len + 1 : 1;
+  else if (i == 0)
+    i = 1;
+  if (j < 0)
+    j = j + len + 1;
+  else if (j > len)
+    j = len;
+  if (i > j)
+    lua_pushliteral(L, "");
+  else
+    lua_pushlstring(L, (const char *)buf->data + i - 1, (size_t)(j - i + 1));
+  return 1;
+}
+
+static const luaL_Reg buffer_methods[] = {{"resize", buffer_resize_method},
+                                          {"capacity", buffer_capacity},
+                                          {"tostring", buffer_tostring},
+                                          {NULL, NULL}};
+
+static void buffer_register(lua_State *L) {
+  if (luaL_newmetatable(L, SSS_BUFFER_MT)) {
+    lua_pushcfunction(L, buffer_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pushcfunction(L, buffer_len);
+    lua_setfield(L, -2, "__len");
+    lua_newtable(L);
+    for (const luaL_Reg *f = buffer_methods; f->name != NULL; f++) {
+      lua_pushcfunction(L, f->func);
+      lua_setfield(L, -2, f->name);
+    }
+    lua_setfield(L, -2, "__index");
+  }
+  lua_pop(L, 1);
+}
@@ -0,0 +1,137 @@
+/*
+ * Cache of the Lagrange weights used to combine shares.
+ *
+ * The weights only depend on the field and on the set of x coordinates of
+ * the shares, so a quorum combining over and over skips straight to the
+ * weighted sum. Entries are keyed by the sorted x coordinates and the least
+ * recently used one is replaced when the cache is full.
+ *
+ * This file is included by sss.c and must not be compiled on its own.
+ */
+
+// Number of x coordinate sets whose weights are kept
+#define WEIGHTS_CACHE_SIZE 16
+
+typedef struct weights_entry_st {
+  // Field of the weights: 0 for GF(2^8), the prime length otherwise
+  uint16_t field;
+  // Number of shares
+  uint16_t k;
+  // Length in bytes of an x coordinate
+  uint16_t len;
+  // Length in bytes of a weight
+  uint16_t w_len;
+  // Allocated size of data
+  size_t size;
+  // Sorted x coordinates followed by their weights, in the same order
+  uint8_t *data;
+  // Value of the cache clock when last used, 0 when empty
+  unsigned long used;
+} weights_entry;
+
+typedef struct weights_cache_st {
+  weights_entry entries[WEIGHTS_CACHE_SIZE];
+  unsigned long clock;
+  unsigned long hits;
+  unsigned long misses;
+} weights_cache;
+
+// Order the x coordinates: order[i] is the index of the i-th smallest one
+static void weights_cache_sort(int k, uint16_t len, const uint8_t *const *xs,
+                               int *order) {
+  for (int i = 0; i < k; i++) {
+    int j = i;
+    for (; j > 0 && memcmp(xs[order[j - 1]], xs[i], len) > 0; j--)
+      order[j] = order[j - 1];
+    order[j] = i;
+  }
+}
+
+// Find the entry of the x coordinates sorted with order
+static weights_entry *weights_cache_find(weights_cache *cache, uint16_t field,
+                                         int k, uint16_t len,
+                                         const uint8_t *const *xs,
+                                         const int *order) {
+  for (int e = 0; e < WEIGHTS_CACHE_SIZE; e++) {
+    weights_entry *entry = &cache->entries[e];
+    int i;
+
+    if (entry->used == 0 || entry->field != field || entry->k != k ||
+        entry->len != len)
+      continue;
+    for (i = 0; i < k; i++) {
+      if (memcmp(entry->data + i * len, xs[order[i]], len) != 0)
+        break;
+    }
+    if (i == k)
+      return entry;
+  }
+  return NULL;
+}
+
+// Look up the weights of the x coordinates, k of len bytes each, weights of
+// w_len bytes. The weights are written in the order of xs. Returns 1 on a
+// hit.
+static int weights_cache_get(weights_cache *cache, uint16_t field, int k,
+                             uint16_t len, const uint8_t *const *xs,
+                             uint16_t w_len, uint8_t *weights) {
+  int order[256];
+  weights_entry *entry;
+
+  weights_cache_sort(k, len, xs, order);
+  entry = weights_cache_find(cache, field, k, len, xs, order);
+  if (entry == NULL || entry->w_len != w_len) {
+    cache->misses++;
+    return 0;
+  }
+
+  const uint8_t *w = entry->data + k * len;
+  for (int i = 0; i < k; i++)
+    memcpy(weights + order[i] * w_len, w + i * w_len, w_len);
+  entry->used = ++cache->clock;
+  cache->hits++;
+  return 1;
+}
+
+// Remember the weights of the x coordinates, given in the order of xs
+static void weights_cache_put(weights_cache *cache, uint16_t field, int k,
+                              uint16_t len, const uint8_t *const *xs,
+                              uint16_t w_len, const uint8_t *weights) {
+  int order[256];
+  weights_entry *entry = &cache->entries[0];
+  size_t size = (size_t)k * (len + w_len);
+
+  weights_cache_sort(k, len, xs, order);
+  if (weights_cache_find(cache, field, k, len, xs, order) != NULL)
+    return;
+
+  // Replace the least recently used entry
+  for (int e = 1; e < WEIGHTS_CACHE_SIZE; e++) {
+    if (cache->entries[e].used < entry->used)
+      entry = &cache->entries[e];
+  }
+  if (entry->size < size) {
+    uint8_t *data = realloc(entry->data, size);
+    if (data == NULL)
+      return;
+    entry->data = data;
+    entry->size = size;
+  }
+
+  uint8_t *w = entry->data + k * len;
+  for (int i = 0; i < k; i++) {
+    memcpy(entry->data + i * len, xs[order[i]], len);
+    memcpy(w + i * w_len, weights + order[i] * w_len, w_len);
+  }
+  entry->field = field;
+  entry->k = k;
+  entry->len = len;
+  entry->w_len = w_len;
+  entry->used = ++cache->clock;
+}
+
+static void weights_cache_free(weights_cache *cache) {
+  for (int e = 0; e < WEIGHTS_CACHE_SIZE; e++)
+    free(cache->entries[e].data);
+  memset(cache, 0, sizeof(*cache));
+}
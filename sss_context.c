@@ -0,0 +1,194 @@
+/*
+ * Prime field contexts.
+ *
+ * sss.context(len, k [, options]) returns a context holding a share object
+ * for secrets of len bytes with a threshold of k. Splits and joins through
+ * the context reuse the decoded prime, the numbers and the reduction context
+ * of the object instead of setting them up on every call. ctx:split(secret,
+ * n) returns the n shares sss.create would with the backend of
+ * options.backend, "prime" or "prime_compact", the prime field by default,
+ * and ctx:join(shares) the secret of k of them, exactly len bytes long. The
+ * weights of the x coordinates of the last join are kept, so joining shares
+ * at the same x coordinates again only takes their weighted sum. The
+ * secrets are cleared from the object after every call.
+ *
+ * This file is included by sss.c and must not be compiled on its own.
+ */
+
+#define SSS_CONTEXT_MT "sss.context"
+
+typedef struct sss_context_st {
+  SHARE *share;
+  // Backend of the shares, prime or prime_compact, and their format
+  const shares_backend *backend;
+  SHARE_FORMAT format;
+  // Length of the secrets and threshold
+  size_t len;
+  int k;
+  // Length of each share
+  size_t row_len;
+  // Shares of the last split and secret of the last join
+  sss_buffer buf;
+  // Rows and x coordinates of the shares of the last split or join
+  sss_buffer rows;
+  // Whether the x coordinates and weights of the last join are kept
+  int joined;
+  uint8_t xs[SHARE_PARTS_MAX * sizeof(prime_256)];
+  uint8_t weights[SHARE_PARTS_MAX * sizeof(prime_256)];
+  // Random coefficients
+  sss_rng rng;
+} sss_context;
+
+#define context_check(L, idx)                                                  \
+  ((sss_context *)luaL_checkudata(L, idx, SSS_CONTEXT_MT))
+
+// sss.context(len, k [, options]) returns a prime field context for secrets
+// of len bytes with a threshold of k
+static int context_new(lua_State *L) {
+  lua_Integer len = luaL_checkinteger(L, 1);
+  lua_Integer k = luaL_checkinteger(L, 2);
+  const shares_backend *prime = shares_backend_find("prime");
+  const shares_backend *compact = shares_backend_find("prime_compact");
+  const shares_backend *backend = prime;
+  sss_context *ctx;
+  SHARE_ERR err;
+
+  if (!lua_isnoneornil(L, 3)) {
+    luaL_checktype(L, 3, LUA_TTABLE);
+    lua_getfield(L, 3, "backend");
+    if (!lua_isnil(L, -1))
+      backend = shares_backend_find(luaL_checkstring(L, -1));
+    lua_pop(L, 1);
+    luaL_argcheck(L, backend == prime || backend == compact, 3,
+                  "not a prime field backend");
+  }
+  luaL_argcheck(L, len > 0 && backend->row_len((size_t)len) > 0, 1,
+                "unsupported secret length");
+  luaL_argcheck(L, k > 1 && k <= SHARE_PARTS_MAX, 2, "out of range");
+  ctx = (sss_context *)lua_newuserdata(L, sizeof(sss_context));
+  memset(ctx, 0, sizeof(*ctx));
+  luaL_getmetatable(L, SSS_CONTEXT_MT);
+  lua_setmetatable(L, -2);
+
+  ctx->len = (size_t)len;
+  ctx->k = (int)k;
+  ctx->backend = backend;
+  ctx->format = backend == compact ? SHARE_FORMAT_COMPACT : SHARE_FORMAT_FULL;
+  ctx->row_len = backend->row_len(ctx->len);
+  err = SHARE_new_impl((uint16_t)(len * 8), (uint8_t)k,
+                       prime_impl_name(sss_state_get(L)), &ctx->share);
+  if (err == NONE)
+    err = SHARE_set_format(ctx->share, ctx->format);
+  if (err != NONE)
+    return luaL_error(L, "not enough memory");
+  rng_fork(&sss_state_get(L)->rng, &ctx->rng);
+  SHARE_set_random(ctx->share, share_rng, &ctx->rng);
+  return 1;
+}
+
+// ctx:split(secret, n [, options]) returns a table of n shares of the
+// secret at the x coordinates 1 to n, or those of the array options.xs
+static int context_split(lua_State *L) {
+  sss_context *ctx = context_check(L, 1);
+  size_t sz;
+  const uint8_t *secret = sss_checkbytes(L, 2, &sz);
+  lua_Integer n = luaL_checkinteger(L, 3);
+  uint8_t **rows;
+  uint16_t *xs;
+  SHARE_ERR err;
+  int i;
+
+  luaL_argcheck(L, sz == ctx->len, 2, "secret length mismatch");
+  luaL_argcheck(L, n >= ctx->k && n <= ctx->backend->x_max, 3,
+                "out of range");
+  if (!shares_buffer_reserve(&ctx->rows, (int)n, &rows, &xs))
+    return luaL_error(L, "not enough memory");
+  check_xs(L, 4, ctx->backend->x_max, (int)n, xs);
+  if (!buffer_reserve(&ctx->buf, (size_t)n * ctx->row_len))
+    return luaL_error(L, "not enough memory");
+
+  for (i = 0; i < n; i++)
+    rows[i] = ctx->buf.data + i * ctx->row_len;
+  err = SHARE_split_init(ctx->share, (uint8_t *)secret);
+  if (err == NONE)
+    err = SHARE_split_at_n(ctx->share, xs, (int)n, rows);
+  if (err == NONE)
+    push_rows(L, rows, (int)n, ctx->row_len);
+  SHARE_clear(ctx->share);
+  sss_wipe(ctx->buf.data, (size_t)n * ctx->row_len);
+  return err == NONE;
+}
+
+// ctx:join(shares) returns the secret of the first k shares of the table or
+// share set, nil when it can't be recovered
+static int context_join(lua_State *L) {
+  sss_context *ctx = context_check(L, 1);
+  const shares_backend *backend = ctx->backend;
+  uint8_t **rows;
+  size_t size;
+  int n = check_shares(L, 2, backend, NULL, &size);
+  size_t x_len = ctx->format == SHARE_FORMAT_COMPACT ? PRIME_COMPACT_X_LEN
+                                                    : prime_x_len(size);
+  SHARE_ERR err;
+  int i, same;
+
+  if (!shares_buffer_reserve(&ctx->rows, n, &rows, NULL))
+    return luaL_error(L, "not enough memory");
+  check_shares(L, 2, backend, rows, &size);
+  luaL_argcheck(L, size == ctx->row_len, 2, "share length mismatch");
+  luaL_argcheck(L, n >= ctx->k, 2, "not enough shares");
+  if (!buffer_reserve(&ctx->buf, ctx->len))
+    return luaL_error(L, "not enough memory");
+
+  same = ctx->joined;
+  for (i = 0; same && i < ctx->k; i++)
+    same = memcmp(ctx->xs + i * x_len, rows[i], x_len) == 0;
+
+  err = SHARE_join_init(ctx->share);
+  for (i = 0; err == NONE && i < ctx->k; i++)
+    err = SHARE_join_update(ctx->share, rows[i]);
+  if (err == NONE && !same) {
+    ctx->joined = 0;
+    err = SHARE_join_weights(ctx->share, ctx->weights);
+    for (i = 0; err == NONE && i < ctx->k; i++)
+      memcpy(ctx->xs + i * x_len, rows[i], x_len);
+    ctx->joined = err == NONE;
+  }
+  if (err == NONE)
+    err = SHARE_join_final_weights(ctx->share, ctx->weights, ctx->buf.data);
+  if (err == NONE)
+    lua_pushlstring(L, (const char *)ctx->buf.data, ctx->len);
+  else
+    lua_pushnil(L);
+  SHARE_clear(ctx->share);
+  sss_wipe(ctx->buf.data, ctx->len);
+  return 1;
+}
+
+static int context_gc(lua_State *L) {
+  sss_context *ctx = context_check(L, 1);
+
+  SHARE_free(ctx->share);
+  ctx->share = NULL;
+  buffer_free(&ctx->buf);
+  buffer_free(&ctx->rows);
+  rng_free(&ctx->rng);
+  return 0;
+}
+
+static const luaL_Reg context_methods[] = {
+    {"split", context_split}, {"join", context_join}, {NULL, NULL}};
+
+static void context_register(lua_State *L) {
+  if (luaL_newmetatable(L, SSS_CONTEXT_MT)) {
+    lua_pushcfunction(L, context_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_newtable(L);
+    for (const luaL_Reg *f = context_methods; f->name != NULL; f++) {
+      lua_pushcfunction(L, f->func);
+      lua_setfield(L, -2, f->name);
+    }
+    lua_setfield(L, -2, "__index");
+  }
+  lua_pop(L, 1);
+}
@@ -0,0 +1,196 @@
+/*
+ * Worker threads of a Lua state.
+ *
+ * A job is a function run over a range of items, cut in as many contiguous
+ * parts as there are threads. The calling thread works on the first part
+ * while the workers take the others, then waits for all of them. Jobs never
+ * call into Lua, so the Lua state is left alone while they run. Without
+ * PTHREADS every job runs on the calling thread.
+ *
+ * This file is included by sss.c and must not be compiled on its own.
+ */
+
+#if defined(PTHREADS)
+#include <pthread.h>
+#endif
+
+// Most threads working on a job, the calling thread included
+#define POOL_THREADS_MAX 64
+
+// Work on the items begin to end - 1, t being the index of the thread
+typedef void (*pool_func)(void *arg, int t, size_t begin, size_t end);
+
+struct sss_pool_st;
+
+typedef struct pool_worker_st {
+  struct sss_pool_st *pool;
+  // Index of the thread, the calling thread being 0
+  int index;
+  // Sequence number of the last job seen
+  unsigned long job;
+#if defined(PTHREADS)
+  pthread_t thread;
+#endif
+} pool_worker;
+
+typedef struct sss_pool_st {
+  // Number of threads working on a job, the calling thread included
+  int threads;
+#if defined(PTHREADS)
+  pool_worker workers[POOL_THREADS_MAX];
+  pthread_mutex_t lock;
+  // Signaled when a job is posted or the workers have to quit
+  pthread_cond_t wake;
+  // Signaled when the last worker is done with a job
+  pthread_cond_t idle;
+  // Serializes the state the parts of a job share
+  pthread_mutex_t guard;
+  // The current job
+  pool_func func;
+  void *arg;
+  size_t cnt;
+  int parts;
+  // Sequence number of the current job
+  unsigned long job;
+  // Number of workers still working on the current job
+  int busy;
+  int quit;
+#endif
+} sss_pool;
+
+#if defined(PTHREADS)
+// Run part of a job on the thread t
+static void pool_run_part(sss_pool *pool, int t) {
+  size_t begin = pool->cnt * t / pool->parts;
+  size_t end = pool->cnt * (t + 1) / pool->parts;
+
+  if (begin < end)
+    pool->func(pool->arg, t, begin, end);
+}
+
+static void *pool_worker_main(void *arg) {
+  pool_worker *worker = (pool_worker *)arg;
+  sss_pool *pool = worker->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (pool->job == worker->job && !pool->quit)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    if (pool->quit)
+      break;
+    worker->job = pool->job;
+
+    if (worker->index < pool->parts) {
+      pthread_mutex_unlock(&pool->lock);
+      pool_run_part(pool, worker->index);
+      pthread_mutex_lock(&pool->lock);
+    }
+    if (--pool->busy == 0)
+      pthread_cond_signal(&pool->idle);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+// Stop and join all the workers
+static void pool_stop(sss_pool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = 1;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int t = 1; t < pool->threads; t++)
+    pthread_join(pool->workers[t].thread, NULL);
+  pool->threads = 1;
+  pool->quit = 0;
+}
+#endif
+
+static void pool_init(sss_pool *pool) {
+  pool->threads = 1;
+#if defined(PTHREADS)
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+  pthread_mutex_init(&pool->guard, NULL);
+#endif
+}
+
+// Run the jobs with threads threads. Returns the number of threads that
+// could be started.
+static int pool_resize(sss_pool *pool, int threads) {
+#if defined(PTHREADS)
+  if (threads > POOL_THREADS_MAX)
+    threads = POOL_THREADS_MAX;
+  if (threads == pool->threads)
+    return threads;
+
+  pool_stop(pool);
+  for (int t = 1; t < threads; t++) {
+    pool_worker *worker = &pool->workers[t];
+    worker->pool = pool;
+    worker->index = t;
+    worker->job = pool->job;
+    if (pthread_create(&worker->thread, NULL, pool_worker_main, worker) != 0)
+      break;
+    pool->threads++;
+  }
+#else
+  (void)threads;
+#endif
+  return pool->threads;
+}
+
+static void pool_free(sss_pool *pool) {
+#if defined(PTHREADS)
+  pool_stop(pool);
+  pthread_mutex_destroy(&pool->guard);
+  pthread_cond_destroy(&pool->idle);
+  pthread_cond_destroy(&pool->wake);
+  pthread_mutex_destroy(&pool->lock);
+#else
+  (void)pool;
+#endif
+}
+
+// Run func over cnt items, giving each thread at least grain items
+static void pool_run(sss_pool *pool, pool_func func, void *arg, size_t cnt,
+                     size_t grain) {
+  size_t parts = grain > 0 ? cnt / grain : cnt;
+
+  if (parts > (size_t)pool->threads)
+    parts = pool->threads;
+  if (parts <= 1) {
+    if (cnt > 0)
+      func(arg, 0, 0, cnt);
+    return;
+  }
+
+#if defined(PTHREADS)
+  pthread_mutex_lock(&pool->lock);
+  pool->func = func;
+  pool->arg = arg;
+  pool->cnt = cnt;
+  pool->parts = (int)parts;
+  pool->busy = pool->threads - 1;
+  pool->job++;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  pool_run_part(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->busy > 0)
+    pthread_cond_wait(&pool->idle, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+// Enter and leave the section of a job using state shared by its parts
+#if defined(PTHREADS)
+#define pool_enter(pool) pthread_mutex_lock(&(pool)->guard)
+#define pool_leave(pool) pthread_mutex_unlock(&(pool)->guard)
+#else
+#define pool_enter(pool) ((void)(pool))
+#define pool_leave(pool) ((void)(pool))
+#endif
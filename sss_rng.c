@@ -0,0 +1,202 @@
+/*
+ * Random bytes from a ChaCha20 keystream.
+ *
+ * The generator is seeded with 32 bytes from the operating system and then
+ * fills a buffer of keystream at a time, handing out bytes from it without
+ * system calls or locks. The first 32 bytes of every refill become the next
+ * key and are wiped, so a generator captured later can't give back the
+ * bytes it already handed out. A generator must only be used by one thread;
+ * others get their own, seeded from it with rng_fork(). A generator notices
+ * when the process was forked since it was seeded and reseeds from the
+ * operating system, so that parent and children don't share a keystream.
+ *
+ * This file is included by sss.c and must not be compiled on its own.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/random.h>
+#endif
+
+// Bytes of keystream generated at a time
+#define RNG_BUFFER_SIZE 4096
+#define RNG_KEY_SIZE 32
+
+typedef struct sss_rng_st {
+  uint32_t key[8];
+  // Keystream not handed out yet, from pos to the end
+  uint8_t buf[RNG_BUFFER_SIZE];
+  size_t pos;
+  // Process the generator was seeded in
+  pid_t pid;
+} sss_rng;
+
+#define RNG_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define RNG_QUARTER_ROUND(a, b, c, d)                                          \
+  do {                                                                         \
+    a += b, d ^= a, d = RNG_ROTL(d, 16);                                       \
+    c += d, b ^= c, b = RNG_ROTL(b, 12);                                       \
+    a += b, d ^= a, d = RNG_ROTL(d, 8);                                        \
+    c += d, b ^= c, b = RNG_ROTL(b, 7);                                        \
+  } while (0)
+
+// One 64 byte block of the keystream of the key, at the counter
+static void rng_block(const uint32_t *key, uint64_t counter, uint8_t *out) {
+  uint32_t in[16] = {0x61707865,
+                     0x3320646e,
+                     0x79622d32,
+                     0x6b206574,
+                     key[0],
+                     key[1],
+                     key[2],
+                     key[3],
+                     key[4],
+                     key[5],
+                     key[6],
+                     key[7],
+                     (uint32_t)counter,
+                     (uint32_t)(counter >> 32),
+                     0,
+                     0};
+  uint32_t x[16];
+
+  memcpy(x, in, sizeof(x));
+  for (int i = 0; i < 10; i++) {
+    RNG_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+    RNG_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+    RNG_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+    RNG_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+    RNG_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+    RNG_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+    RNG_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+    RNG_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+  }
+  for (int i = 0; i < 16; i++) {
+    uint32_t v = x[i] + in[i];
+    out[4 * i] = (uint8_t)v;
+    out[4 * i + 1] = (uint8_t)(v >> 8);
+    out[4 * i + 2] = (uint8_t)(v >> 16);
+    out[4 * i + 3] = (uint8_t)(v >> 24);
+  }
+}
+
+// Generate len bytes of keystream into out, a multiple of 64 bytes,
+// starting with the next key which is taken out
+static void rng_generate(sss_rng *rng, uint8_t *out, size_t len) {
+  for (size_t i = 0; i < len; i += 64)
+    rng_block(rng->key, i / 64, out + i);
+  for (int i = 0; i < 8; i++)
+    rng->key[i] = (uint32_t)out[4 * i] | (uint32_t)out[4 * i + 1] << 8 |
+                  (uint32_t)out[4 * i + 2] << 16 |
+                  (uint32_t)out[4 * i + 3] << 24;
+  memset(out, 0, RNG_KEY_SIZE);
+}
+
+// Key the generator with 32 bytes of seed
+static void rng_seed(sss_rng *rng, const uint8_t *seed) {
+  for (int i = 0; i < 8; i++)
+    rng->key[i] = (uint32_t)seed[4 * i] | (uint32_t)seed[4 * i + 1] << 8 |
+                  (uint32_t)seed[4 * i + 2] << 16 |
+                  (uint32_t)seed[4 * i + 3] << 24;
+  rng->pos = RNG_BUFFER_SIZE;
+  rng->pid = getpid();
+}
+
+// Fill buf with len bytes of entropy. Returns 0 on failure.
+static int rng_entropy(uint8_t *buf, size_t len) {
+#if defined(__linux__)
+  while (len > 0) {
+    ssize_t got = getrandom(buf, len, 0);
+    if (got < 0) {
+      if (errno == EINTR)
+        continue;
+      return 0;
+    }
+    buf += got;
+    len -= got;
+  }
+  return 1;
+#elif defined(__APPLE__)
+  return getentropy(buf, len) == 0;
+#else
+  FILE *f = fopen("/dev/urandom", "rb");
+  size_t got = 0;
+
+  if (f != NULL) {
+    got = fread(buf, 1, len, f);
+    fclose(f);
+  }
+  return got == len;
+#endif
+}
+
+// Seed the generator from the operating system. Returns 0 on failure.
+static int rng_init(sss_rng *rng) {
+  uint8_t seed[RNG_KEY_SIZE];
+  int ok = rng_entropy(seed, sizeof(seed));
+
+  rng_seed(rng, seed);
+  sss_wipe(seed, sizeof(seed));
+  return ok;
+}
+
+// Reseed the generator in a forked process from the operating system, or
+// failing that mix the process id into the key, dropping the keystream left
+// from the parent either way
+static void rng_reseed(sss_rng *rng) {
+  uint8_t seed[RNG_KEY_SIZE];
+
+  if (rng_entropy(seed, sizeof(seed))) {
+    rng_seed(rng, seed);
+  } else {
+    rng->key[0] ^= (uint32_t)getpid();
+    rng->pos = RNG_BUFFER_SIZE;
+    rng->pid = getpid();
+  }
+  sss_wipe(seed, sizeof(seed));
+  sss_wipe(rng->buf, sizeof(rng->buf));
+}
+
+// Fill out with len random bytes
+static void rng_bytes(sss_rng *rng, uint8_t *out, size_t len) {
+  if (rng->pid != getpid())
+    rng_reseed(rng);
+  while (len > 0) {
+    if (rng->pos == RNG_BUFFER_SIZE) {
+      // Large requests are generated in place, but for the key
+      if (len >= RNG_BUFFER_SIZE) {
+        size_t whole = len / 64 * 64;
+        rng_generate(rng, out, whole);
+        memmove(out, out + RNG_KEY_SIZE, whole - RNG_KEY_SIZE);
+        out += whole - RNG_KEY_SIZE;
+        len -= whole - RNG_KEY_SIZE;
+        continue;
+      }
+      rng_generate(rng, rng->buf, RNG_BUFFER_SIZE);
+      rng->pos = RNG_KEY_SIZE;
+    }
+
+    size_t n = RNG_BUFFER_SIZE - rng->pos;
+    if (n > len)
+      n = len;
+    memcpy(out, rng->buf + rng->pos, n);
+    memset(rng->buf + rng->pos, 0, n);
+    rng->pos += n;
+    out += n;
+    len -= n;
+  }
+}
+
+// Seed child from the output of rng
+static void rng_fork(sss_rng *rng, sss_rng *child) {
+  uint8_t seed[RNG_KEY_SIZE];
+
+  rng_bytes(rng, seed, sizeof(seed));
+  rng_seed(child, seed);
+  sss_wipe(seed, sizeof(seed));
+}
+
+static void rng_free(sss_rng *rng) { sss_wipe(rng, sizeof(*rng)); }
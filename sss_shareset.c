@@ -0,0 +1,164 @@
+/*
+ * Share sets: the n shares of a secret in a single userdata.
+ *
+ * The rows of the share matrix are stored back to back right after the
+ * header, in one allocation owned by the Lua collector. Shares only become
+ * Lua strings when set:get() is called, and set:write() sends a row to a
+ * file without creating one. A slice is a set that points into the rows of
+ * another one and keeps it alive through a registry reference.
+ *
+ * This file is included by sss.c and must not be compiled on its own.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#define SSS_SHARESET_MT "sss.shareset"
+
+typedef struct sss_shareset_st {
+  // First row
+  uint8_t *data;
+  // Length of each share
+  size_t row_len;
+  // Number of shares
+  int n;
+  // Reference to the set owning the rows of a slice, LUA_NOREF otherwise
+  int owner;
+} sss_shareset;
+
+#define shareset_check(L, idx)                                                 \
+  ((sss_shareset *)luaL_checkudata(L, idx, SSS_SHARESET_MT))
+
+#define shareset_row(set, i) ((set)->data + (size_t)(i) * (set)->row_len)
+
+// Push a new set of n shares of row_len bytes, the rows left uninitialized
+static sss_shareset *shareset_new(lua_State *L, int n, size_t row_len) {
+  sss_shareset *set = (sss_shareset *)lua_newuserdata(
+      L, sizeof(sss_shareset) + (size_t)n * row_len);
+
+  set->data = (uint8_t *)(set + 1);
+  set->row_len = row_len;
+  set->n = n;
+  set->owner = LUA_NOREF;
+  luaL_getmetatable(L, SSS_SHARESET_MT);
+  lua_setmetatable(L, -2);
+  return set;
+}
+
+// The index of the share at idx, from 1 to the number of shares
+static int shareset_checkindex(lua_State *L, sss_shareset *set, int idx) {
+  lua_Integer i = luaL_checkinteger(L, idx);
+
+  luaL_argcheck(L, i >= 1 && i <= set->n, idx, "share index out of range");
+  return (int)i - 1;
+}
+
+static int shareset_gc(lua_State *L) {
+  sss_shareset *set = shareset_check(L, 1);
+
+  if (set->owner == LUA_NOREF)
+    sss_wipe(set->data, (size_t)set->n * set->row_len);
+  else
+    luaL_unref(L, LUA_REGISTRYINDEX, set->owner);
+  set->n = 0;
+  set->owner = LUA_NOREF;
+  return 0;
+}
+
+static int shareset_len(lua_State *L) {
+  lua_pushinteger(L, shareset_check(L, 1)->n);
+  return 1;
+}
+
+// set:get(i) returns share i as a string
+static int shareset_get(lua_State *L) {
+  sss_shareset *set = shareset_check(L, 1);
+  int i = shareset_checkindex(L, set, 2);
+
+  lua_pushlstring(L, (const char *)shareset_row(set, i), set->row_len);
+  return 1;
+}
+
+// set:ptr(i) returns the address of share i and its length. The memory
+// belongs to the set and is only valid as long as the set is referenced.
+static int shareset_ptr(lua_State *L) {
+  sss_shareset *set = shareset_check(L, 1);
+  int i = shareset_checkindex(L, set, 2);
+
+  lua_pushlightuserdata(L, shareset_row(set, i));
+  lua_pushinteger(L, (lua_Integer)set->row_len);
+  return 2;
+}
+
+// set:write(i, fh) writes share i to an open Lua file. Returns true, or nil
+// and an error message like the io functions.
+static int shareset_write(lua_State *L) {
+  sss_shareset *set = shareset_check(L, 1);
+  int i = shareset_checkindex(L, set, 2);
+  FILE *f;
+
+#if LUA_VERSION_NUM > 501
+  luaL_Stream *stream = (luaL_Stream *)luaL_checkudata(L, 3, LUA_FILEHANDLE);
+  f = stream->closef != NULL ? stream->f : NULL;
+#else
+  f = *(FILE **)luaL_checkudata(L, 3, LUA_FILEHANDLE);
+#endif
+  luaL_argcheck(L, f != NULL, 3, "attempt to use a closed file");
+
+  if (fwrite(shareset_row(set, i), 1, set->row_len, f) != set->row_len) {
+    int err = errno;
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(err));
+    lua_pushinteger(L, err);
+    return 3;
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+// set:slice(i [, j]) returns a set of the shares i to j, sharing their memory
+static int shareset_slice(lua_State *L) {
+  sss_shareset *set = shareset_check(L, 1);
+  int i = shareset_checkindex(L, set, 2);
+  int j = lua_isnoneornil(L, 3) ? set->n - 1 : shareset_checkindex(L, set, 3);
+  sss_shareset *slice;
+
+  luaL_argcheck(L, j >= i, 3, "empty slice");
+  slice = (sss_shareset *)lua_newuserdata(L, sizeof(sss_shareset));
+  slice->data = shareset_row(set, i);
+  slice->row_len = set->row_len;
+  slice->n = j - i + 1;
+  slice->owner = LUA_NOREF;
+  luaL_getmetatable(L, SSS_SHARESET_MT);
+  lua_setmetatable(L, -2);
+
+  // Keep the set owning the rows alive, a slice of a slice refers to it too
+  if (set->owner != LUA_NOREF)
+    lua_rawgeti(L, LUA_REGISTRYINDEX, set->owner);
+  else
+    lua_pushvalue(L, 1);
+  slice->owner = luaL_ref(L, LUA_REGISTRYINDEX);
+  return 1;
+}
+
+static const luaL_Reg shareset_methods[] = {{"get", shareset_get},
+                                            {"ptr", shareset_ptr},
+                                            {"write", shareset_write},
+                                            {"slice", shareset_slice},
+                                            {NULL, NULL}};
+
+static void shareset_register(lua_State *L) {
+  if (luaL_newmetatable(L, SSS_SHARESET_MT)) {
+    lua_pushcfunction(L, shareset_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pushcfunction(L, shareset_len);
+    lua_setfield(L, -2, "__len");
+    lua_newtable(L);
+    for (const luaL_Reg *f = shareset_methods; f->name != NULL; f++) {
+      lua_pushcfunction(L, f->func);
+      lua_setfield(L, -2, f->name);
+    }
+    lua_setfield(L, -2, "__index");
+  }
+  lua_pop(L, 1);
+}
@@ -0,0 +1,267 @@
+/*
+ * Streaming split and join of GF(2 ^ 8) secrets.
+ *
+ * Every byte of a secret has its own polynomial, so a secret can be split a
+ * chunk at a time. A splitter computes the powers of the x coordinates once
+ * and, for each chunk of the secret, returns a chunk of every share. The
+ * first chunk of a share starts with its x coordinate, so the concatenated
+ * chunks of a share are the same as a share returned by sss.create. A
+ * joiner reads the x coordinates from the first chunks and then returns a
+ * chunk of the secret for each set of share chunks. Memory only depends on
+ * the chunk size.
+ *
+ * This file is included by sss.c and must not be compiled on its own.
+ */
+
+#define SSS_SPLITTER_MT "sss.splitter"
+#define SSS_JOINER_MT "sss.joiner"
+
+typedef struct sss_splitter_st {
+  // Number of shares and threshold
+  int n;
+  int k;
+  // Whether the chunk with the x coordinates was returned
+  int started;
+  // Whether final was called
+  int done;
+  uint8_t xs[255];
+  // Powers of the x coordinates, n * k bytes following the structure
+  uint8_t *powers;
+  // Coefficients and share chunks of the last update
+  sss_buffer buf;
+  // Random coefficients
+  sss_rng rng;
+  // Dot product kernel of the state that created the splitter
+  p_dot_func dot;
+} sss_splitter;
+
+typedef struct sss_joiner_st {
+  // Number of shares, 0 until the first update
+  int k;
+  // Whether final was called
+  int done;
+  // Lagrange coefficients of the x coordinates
+  uint8_t coeffs[255];
+  // Secret chunk of the last update
+  sss_buffer buf;
+  // Dot product kernel of the state that created the joiner
+  p_dot_func dot;
+} sss_joiner;
+
+#define splitter_check(L, idx)                                                 \
+  ((sss_splitter *)luaL_checkudata(L, idx, SSS_SPLITTER_MT))
+#define joiner_check(L, idx)                                                   \
+  ((sss_joiner *)luaL_checkudata(L, idx, SSS_JOINER_MT))
+
+// Wipe what the splitter knows about the polynomials
+static void splitter_clear(sss_splitter *sp) {
+  memset(sp->powers, 0, (size_t)sp->n * sp->k);
+  buffer_free(&sp->buf);
+  rng_free(&sp->rng);
+}
+
+// Split the chunk, with the x coordinates first when hdr is set, and push
+// the n share chunks
+static int splitter_push(lua_State *L, sss_splitter *sp, const uint8_t *chunk,
+                         size_t len, int hdr) {
+  size_t coeffs_len = (size_t)(sp->k - 1) * len;
+  size_t row_len = len + hdr;
+  const uint8_t *coeffs[255];
+  uint8_t *ys[255];
+
+  if (!buffer_reserve(&sp->buf, coeffs_len + sp->n * row_len))
+    return luaL_error(L, "not enough memory");
+
+  uint8_t *out = sp->buf.data + coeffs_len;
+  for (int i = 0; i < sp->n; i++) {
+    if (hdr)
+      out[i * row_len] = sp->xs[i];
+    ys[i] = out + i * row_len + hdr;
+  }
+  for (int j = 0; j < sp->k - 1; j++)
+    coeffs[j] = sp->buf.data + j * len;
+  rng_bytes(&sp->rng, sp->buf.data, coeffs_len);
+  split_eval(sp->dot, chunk, len, sp->n, sp->k, sp->powers, coeffs, ys);
+
+  lua_createtable(L, sp->n, 0);
+  for (int i = 0; i < sp->n; i++) {
+    lua_pushlstring(L, (const char *)out + i * row_len, row_len);
+    lua_rawseti(L, -2, i + 1);
+  }
+  memset(sp->buf.data, 0, coeffs_len + sp->n * row_len);
+  return 1;
+}
+
+// sss.splitter(n, k [, options]) returns a splitter of secrets into n
+// shares with a threshold of k, at the x coordinates 1 to n or options.xs
+static int splitter_new(lua_State *L) {
+  uint16_t xs[255];
+  sss_splitter *sp;
+  int n, k;
+
+  check_threshold(L, 1, shares_backend_find("gf256"), &n, &k);
+  check_xs(L, 3, GF_X_MAX, n, xs);
+  sp = (sss_splitter *)lua_newuserdata(L, sizeof(sss_splitter) + n * k);
+  memset(sp, 0, sizeof(*sp));
+  sp->n = n;
+  sp->k = k;
+  sp->powers = (uint8_t *)(sp + 1);
+  luaL_getmetatable(L, SSS_SPLITTER_MT);
+  lua_setmetatable(L, -2);
+
+  rng_fork(&sss_state_get(L)->rng, &sp->rng);
+  sp->dot = sss_state_dot(sss_state_get(L));
+  for (int i = 0; i < n; i++)
+    sp->xs[i] = (uint8_t)xs[i];
+  split_powers(sp->xs, n, k, sp->powers);
+  return 1;
+}
+
+// splitter:update(chunk) returns the table of the n share chunks
+static int splitter_update(lua_State *L) {
+  sss_splitter *sp = splitter_check(L, 1);
+  size_t len;
+  const uint8_t *chunk = sss_checkbytes(L, 2, &len);
+  int hdr = !sp->started;
+
+  luaL_argcheck(L, !sp->done, 1, "splitter finished");
+  splitter_push(L, sp, chunk, len, hdr);
+  sp->started = 1;
+  return 1;
+}
+
+// splitter:final() returns the table of the last share chunks, only holding
+// the x coordinates when no chunk was split
+static int splitter_final(lua_State *L) {
+  sss_splitter *sp = splitter_check(L, 1);
+
+  luaL_argcheck(L, !sp->done, 1, "splitter finished");
+  splitter_push(L, sp, NULL, 0, !sp->started);
+  sp->started = 1;
+  sp->done = 1;
+  splitter_clear(sp);
+  return 1;
+}
+
+static int splitter_gc(lua_State *L) {
+  splitter_clear(splitter_check(L, 1));
+  return 0;
+}
+
+// sss.joiner() returns a joiner of share chunks
+static int joiner_new(lua_State *L) {
+  sss_joiner *jn = (sss_joiner *)lua_newuserdata(L, sizeof(sss_joiner));
+
+  memset(jn, 0, sizeof(*jn));
+  jn->dot = sss_state_dot(sss_state_get(L));
+  luaL_getmetatable(L, SSS_JOINER_MT);
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+// joiner:update(chunks) returns the chunk of the secret joined from the
+// table of share chunks, given in the same order on every call. Returns nil
+// when the x coordinates can't be interpolated.
+static int joiner_update(lua_State *L) {
+  sss_joiner *jn = joiner_check(L, 1);
+  const uint8_t *ys[255];
+  size_t len = 0;
+  int k, hdr = jn->k == 0;
+
+  luaL_argcheck(L, !jn->done, 1, "joiner finished");
+  luaL_checktype(L, 2, LUA_TTABLE);
+  k = lua_objlen(L, 2);
+  if (hdr)
+    luaL_argcheck(L, k > 1 && k <= 255, 2, "out of range");
+  else
+    luaL_argcheck(L, k == jn->k, 2, "number of shares changed");
+
+  for (int i = 0; i < k; i++) {
+    size_t sz;
+    lua_rawgeti(L, 2, i + 1);
+    ys[i] = sss_checkbytes(L, -1, &sz);
+    lua_pop(L, 1);
+    if (i == 0)
+      len = sz;
+    else
+      luaL_argcheck(L, len == sz, 2, "partial secret length mismatch");
+  }
+
+  if (hdr) {
+    uint8_t xs[255];
+
+    luaL_argcheck(L, len > 0, 2, "x coordinates expected");
+    for (int i = 0; i < k; i++) {
+      xs[i] = ys[i][0];
+      ys[i]++;
+    }
+    if (!lagrange_coeffs(xs, k, jn->coeffs)) {
+      lua_pushnil(L);
+      return 1;
+    }
+    jn->k = k;
+    len--;
+  }
+  if (len == 0) {
+    lua_pushliteral(L, "");
+    return 1;
+  }
+
+  if (!buffer_resize(&jn->buf, len))
+    return luaL_error(L, "not enough memory");
+  join(jn->dot, ys, len, k, jn->coeffs, jn->buf.data);
+  lua_pushlstring(L, (const char *)jn->buf.data, len);
+  memset(jn->buf.data, 0, len);
+  return 1;
+}
+
+// joiner:final() ends the stream and returns the empty last chunk of the
+// secret, nil when no chunk was joined
+static int joiner_final(lua_State *L) {
+  sss_joiner *jn = joiner_check(L, 1);
+
+  luaL_argcheck(L, !jn->done, 1, "joiner finished");
+  jn->done = 1;
+  if (jn->k == 0)
+    lua_pushnil(L);
+  else
+    lua_pushliteral(L, "");
+  memset(jn->coeffs, 0, sizeof(jn->coeffs));
+  buffer_free(&jn->buf);
+  return 1;
+}
+
+static int joiner_gc(lua_State *L) {
+  sss_joiner *jn = joiner_check(L, 1);
+
+  memset(jn->coeffs, 0, sizeof(jn->coeffs));
+  buffer_free(&jn->buf);
+  return 0;
+}
+
+static const luaL_Reg splitter_methods[] = {
+    {"update", splitter_update}, {"final", splitter_final}, {NULL, NULL}};
+
+static const luaL_Reg joiner_methods[] = {
+    {"update", joiner_update}, {"final", joiner_final}, {NULL, NULL}};
+
+// Create the metatable tname with a finalizer and methods
+static void stream_register_type(lua_State *L, const char *tname,
+                                 lua_CFunction gc, const luaL_Reg *methods) {
+  if (luaL_newmetatable(L, tname)) {
+    lua_pushcfunction(L, gc);
+    lua_setfield(L, -2, "__gc");
+    lua_newtable(L);
+    for (const luaL_Reg *f = methods; f->name != NULL; f++) {
+      lua_pushcfunction(L, f->func);
+      lua_setfield(L, -2, f->name);
+    }
+    lua_setfield(L, -2, "__index");
+  }
+  lua_pop(L, 1);
+}
+
+static void stream_register(lua_State *L) {
+  stream_register_type(L, SSS_SPLITTER_MT, splitter_gc, splitter_methods);
+  stream_register_type(L, SSS_JOINER_MT, joiner_gc, joiner_methods);
+}
@@ -23,3 +23,395 @@ local rec = assert(sss.combine(t, 32));
 
 print('rec', bin2hex(rec))
 assert(rec==msg)
+
+-- GF(2^8) shares are one byte longer than the secret
+local gf256 = #t[1] == #msg + 1
+
+if gf256 then
+  for _, len in ipairs({1, 31, 1000, 5000}) do
+    msg = sss.random(len)
+    t = assert(sss.create(msg, 6, 4))
+    table.remove(t, 2)
+    table.remove(t, 4)
+    assert(sss.combine(t) == msg)
+  end
+  -- every engine computes the same field arithmetic
+  local default = sss.engine()
+  msg = sss.random(200)
+  for _, name in ipairs({'scalar', 'bitslice', 'ssse3', 'avx2'}) do
+    if pcall(sss.engine, name) then
+      t = assert(sss.create(msg, 5, 3))
+      sss.engine(default)
+      assert(sss.combine({t[5], t[1], t[3]}) == msg)
+      sss.engine(name)
+      assert(sss.combine({t[2], t[4], t[1]}) == msg)
+    end
+  end
+  sss.engine(default)
+  assert(not pcall(sss.engine, 'none'))
+
+  -- the same x twice can't be interpolated
+  assert(sss.combine({t[1], t[2], t[1]}) == nil)
+end
+
+-- x is 1 to n unless given
+msg = sss.random(16)
+t = assert(sss.create(msg, 4, 2))
+local xlen = gf256 and 1 or #t[1] / 2
+for i = 1, 4 do
+  assert(t[i]:sub(1, xlen) == ('\0'):rep(xlen - 1) .. string.char(i))
+end
+t = assert(sss.create(msg, 3, 2, {xs = {200, 7, 42}}))
+assert(t[1]:byte(xlen) == 200 and t[2]:byte(xlen) == 7)
+assert(sss.combine({t[3], t[1]}) == msg)
+assert(sss.combine({t[2], t[3]}) == msg)
+assert(not pcall(sss.create, msg, 3, 2, {xs = {1, 2}}))
+assert(not pcall(sss.create, msg, 3, 2, {xs = {1, 0, 2}}))
+assert(not pcall(sss.create, msg, 3, 2, {xs = {1, 2, 1}}))
+assert(not pcall(sss.create, msg, 2, 2, {xs = {1, gf256 and 256 or 65536}}))
+
+-- both fields are built in, chosen per call or as the default
+local backend = sss.backend()
+assert(backend == (gf256 and 'gf256' or 'prime'))
+msg = sss.random(32)
+for name, len in pairs({gf256 = 33, prime = 66}) do
+  t = assert(sss.create(msg, 3, 2, {backend = name}))
+  assert(#t[1] == len)
+  assert(sss.combine({t[3], t[1]}, {backend = name}) == msg)
+  assert(sss.backend(name) == name)
+  assert(#sss.create(msg, 3, 2)[1] == len)
+  assert(sss.combine_many({{t[2], t[1]}})[1] == msg)
+end
+-- every prime size; shorter secrets come back zero padded to the prime's
+for _, len in ipairs({1, 16, 17, 24, 25, 31}) do
+  msg = sss.random(len)
+  t = assert(sss.create(msg, 5, 3, {backend = 'prime'}))
+  local rec = sss.combine({t[4], t[2], t[5]}, {backend = 'prime'})
+  assert(rec == ('\0'):rep(#rec - len) .. msg)
+  assert(sss.combine({t[1], t[3], t[1]}, {backend = 'prime'}) == nil)
+end
+-- longer secrets are cut in 32 byte blocks under a single x coordinate
+for _, len in ipairs({33, 64, 100, 1000}) do
+  msg = sss.random(len)
+  t = assert(sss.create(msg, 5, 3, {backend = 'prime', xs = {9, 8, 7, 6, 5}}))
+  assert(#t[1] == 33 * (1 + math.ceil(len / 32)))
+  assert(t[2]:sub(1, 33) == ('\0'):rep(32) .. '\8')
+  local rec = sss.combine({t[4], t[2], t[5]}, {backend = 'prime'})
+  assert(rec == ('\0'):rep(#rec - len) .. msg)
+  assert(sss.combine({t[1], t[3], t[1]}, {backend = 'prime'}) == nil)
+end
+-- prime field shares are calculated in batches of x coordinates
+for _, opts in ipairs({{backend = 'prime'}, {backend = 'prime_compact'}}) do
+  msg = sss.random(40)
+  t = assert(sss.create(msg, 21, 16, opts))
+  local last = {}
+  for i = 1, 16 do
+    last[i] = t[22 - i]
+  end
+  local rec = sss.combine(last, opts)
+  assert(rec == ('\0'):rep(#rec - 40) .. msg)
+end
+-- compact prime field shares have a version byte and a 2 byte x coordinate
+local compact = {backend = 'prime_compact'}
+for _, len in ipairs({16, 32, 100}) do
+  msg = sss.random(len)
+  local xs = {300, 2, 3, 255, 1}
+  t = assert(sss.create(msg, 5, 3, {backend = 'prime_compact', xs = xs}))
+  assert(#t[1] == 3 + 33 * math.ceil(len / 32) - (len == 16 and 16 or 0))
+  assert(t[4]:sub(1, 3) == '\1\0\255' and t[1]:sub(1, 3) == '\1\1\44')
+  local rec = sss.combine({t[4], t[2], t[5]}, compact)
+  assert(rec == ('\0'):rep(#rec - len) .. msg)
+  assert(sss.combine({t[1], t[3], t[2]}, compact) == rec)
+  assert(sss.combine({t[1], t[3], t[1]}, compact) == nil)
+  assert(sss.combine({'\2' .. t[4]:sub(2), t[2], t[5]}, compact) == nil)
+  assert(not pcall(sss.combine, {t[4], t[2], t[5]}, {backend = 'prime'}))
+end
+-- GF(2 ^ 16) takes up to 65535 shares and thresholds past 255
+local wide = {backend = 'gf65536'}
+msg = sss.random(32)
+t = assert(sss.create(msg, 2000, 50, wide))
+assert(#t == 2000 and #t[1] == 34)
+assert(t[1999]:sub(1, 2) == '\7\207')
+local quorum = {}
+for i = 1, 50 do
+  quorum[i] = t[i * 40 - 7]
+end
+assert(sss.combine(quorum, wide) == msg)
+assert(sss.combine_many({quorum, quorum}, wide)[2] == msg)
+quorum[50] = quorum[1]
+assert(sss.combine(quorum, wide) == nil)
+t = assert(sss.create(msg, 300, 300, wide))
+assert(sss.combine(t, wide) == msg)
+assert(not pcall(sss.create, msg, 300, 300))
+for _, len in ipairs({1, 7, 3000}) do
+  msg = sss.random(len)
+  local xs = {65535, 2, 3, 9, 1}
+  t = assert(sss.create(msg, 5, 3, {backend = 'gf65536', xs = xs}))
+  local rec = sss.combine({t[5], t[1], t[3]}, wide)
+  assert(rec == msg and #t[1] == 2 + len + 2 * (len % 2))
+  if len % 2 == 1 then
+    local bad = t[3]:sub(1, -2) .. '\2'
+    assert(sss.combine({t[5], t[1], bad}, wide) == nil)
+  end
+end
+assert(not pcall(sss.create, msg, 65536, 2, wide))
+assert(not pcall(sss.combine, {'\0\1\2'}, wide))
+sss.backend(backend)
+assert(not pcall(sss.backend, 'none'))
+assert(not pcall(sss.create, msg, 3, 2, {backend = 'none'}))
+
+-- every prime field implementation combines the shares of the others
+local impls = {}
+for _, name in ipairs({'Native', 'OpenSSL Montgomery', 'OpenSSL Generic'}) do
+  if pcall(sss.prime_impl, name) then
+    impls[#impls + 1] = name
+  end
+end
+assert(#impls >= 2 and sss.prime_impl(false) == nil)
+for _, len in ipairs({16, 24, 32, 100}) do
+  msg = sss.random(len)
+  for _, from in ipairs(impls) do
+    for _, name in ipairs({'prime', 'prime_compact'}) do
+      local opts = {backend = name, xs = {3, 1000, 7, 256, 1}}
+      assert(sss.prime_impl(from) == from)
+      t = assert(sss.create(msg, 5, 3, opts))
+      for _, to in ipairs(impls) do
+        sss.prime_impl(to)
+        local rec = sss.combine({t[1], t[3], t[5]}, opts)
+        assert(rec == ('\0'):rep(#rec - len) .. msg)
+        assert(sss.combine({t[4], t[2], t[3]}, opts) == rec)
+        local c = sss.context(len, 3, {backend = name})
+        assert(c:join({t[5], t[1], t[3]}) == msg)
+      end
+    end
+  end
+end
+sss.prime_impl(false)
+assert(not pcall(sss.prime_impl, 'none'))
+-- OpenSSL Montgomery at the largest threshold, in blocks and in a context
+assert(sss.prime_impl('OpenSSL Montgomery'))
+msg = sss.random(1000)
+t = assert(sss.create(msg, 20, 16, {backend = 'prime'}))
+local mont = sss.context(32, 16)
+sss.prime_impl(false)
+local last = {}
+for i = 1, 16 do
+  last[i] = t[i + 4]
+end
+local rec = sss.combine(last, {backend = 'prime'})
+assert(rec == ('\0'):rep(#rec - 1000) .. msg)
+msg = sss.random(32)
+t = assert(mont:split(msg, 20))
+for i = 1, 16 do
+  last[i] = t[21 - i]
+end
+assert(mont:join(last) == msg and sss.combine(last, {backend = 'prime'}) == msg)
+assert(mont:join(sss.create(msg, 16, 16, {backend = 'prime'})) == msg)
+-- OpenSSL Generic weights with one inversion, at every threshold
+msg = sss.random(24)
+for k = 2, 16 do
+  local xs = {}
+  for i = 1, k + 1 do
+    xs[i] = i * 97 % 600 + 1
+  end
+  t = assert(sss.create(msg, k + 1, k, {backend = 'prime', xs = xs}))
+  assert(sss.prime_impl('OpenSSL Generic'))
+  local some = {}
+  for i = 1, k do
+    some[i] = t[k + 2 - i]
+  end
+  assert(sss.combine(some, {backend = 'prime'}) == msg)
+  some[k] = some[1]
+  assert(sss.combine(some, {backend = 'prime'}) == nil)
+  sss.prime_impl(false)
+end
+
+-- contexts keep their prime field share object between calls
+local ctx = sss.context(20, 3)
+msg = sss.random(20)
+for _ = 1, 2 do
+  t = assert(ctx:split(msg, 5))
+  assert(#t == 5 and #t[1] == 50)
+  assert(ctx:join({t[5], t[1], t[3]}) == msg)
+  assert(ctx:join(sss.create(msg, 4, 3, {backend = 'prime'})) == msg)
+end
+local rec = sss.combine({t[2], t[3], t[4]}, {backend = 'prime'})
+assert(rec == ('\0'):rep(4) .. msg)
+t = assert(ctx:split(msg, 3, {xs = {700, 8, 9}}))
+assert(ctx:join({t[3], t[1], t[2]}) == msg)
+assert(ctx:join({t[1], t[1], t[2]}) == nil)
+assert(not pcall(ctx.split, ctx, sss.random(19), 5))
+assert(not pcall(ctx.split, ctx, msg, 2))
+assert(not pcall(sss.context, 8192, 3))
+ctx = sss.context(100, 4)
+msg = sss.random(100)
+t = assert(ctx:split(msg, 6))
+assert(ctx:join({t[6], t[2], t[4], t[1]}) == msg)
+assert(ctx:join({t[3], t[5], t[1], t[2]}) == msg)
+-- contexts split into more shares than GF(2^8) has points
+t = assert(ctx:split(msg, 300))
+assert(#t == 300 and ctx:join({t[300], t[256], t[2], t[299]}) == msg)
+-- and into compact shares
+ctx = sss.context(32, 3, {backend = 'prime_compact'})
+msg = sss.random(32)
+t = assert(ctx:split(msg, 5, {xs = {9, 300, 2, 40, 1}}))
+assert(#t[1] == #sss.create(msg, 2, 2, {backend = 'prime_compact'})[1])
+assert(ctx:join({t[2], t[5], t[4]}) == msg)
+rec = sss.combine({t[3], t[1], t[2]}, {backend = 'prime_compact'})
+assert(rec == ('\0'):rep(#rec - 32) .. msg)
+assert(ctx:join(sss.create(msg, 3, 3, {backend = 'prime_compact'})) == msg)
+assert(not pcall(sss.context, 32, 3, {backend = 'gf256'}))
+
+-- combining the same quorum again reuses its Lagrange weights
+msg = sss.random(32)
+t = assert(sss.create(msg, 4, 3, {xs = {11, 12, 13, 14}}))
+local stats = sss.cache_stats()
+assert(sss.combine({t[1], t[2], t[3]}) == msg)
+assert(sss.combine({t[3], t[1], t[2]}) == msg)
+local after = sss.cache_stats()
+assert(after.hits == stats.hits + 1)
+assert(after.misses == stats.misses + 1)
+assert(after.entries >= 1)
+
+-- shares and secrets written into reusable buffers
+msg = sss.random(32)
+local outs = {sss.buffer(), sss.buffer(), sss.buffer(), sss.buffer()}
+assert(sss.create_into(msg, 4, 3, outs) == outs)
+local secret = sss.buffer()
+assert(sss.combine_into({outs[4], outs[2], outs[1]}, secret) == secret)
+assert(#secret == #msg and secret:tostring() == msg)
+assert(sss.combine({outs[1]:tostring(), outs[3], outs[4]}) == msg)
+assert(not pcall(sss.combine_into, {outs[1], outs[2], outs[3]}, outs[1]))
+
+-- share sets keep all the shares in one userdata
+msg = sss.random(32)
+local set = assert(sss.create(msg, 5, 3, {set = true}))
+assert(#set == 5)
+local p, plen = set:ptr(2)
+assert(type(p) == 'userdata' and plen == #set:get(2))
+assert(sss.combine(set) == msg)
+assert(sss.combine(set:slice(3)) == msg)
+assert(#set:slice(2, 4) == 3 and sss.combine(set:slice(2, 4)) == msg)
+assert(sss.combine(set:slice(2, 5):slice(2)) == msg)
+assert(sss.combine({set:get(5), set:get(1), set:get(3)}) == msg)
+assert(not pcall(set.get, set, 6))
+local fh = io.tmpfile()
+assert(set:write(4, fh) == true)
+fh:seek('set')
+assert(fh:read('*a') == set:get(4))
+fh:close()
+assert(not pcall(set.write, set, 1, fh))
+
+-- batches of secrets
+local secrets = {}
+for i = 1, 20 do
+  secrets[i] = sss.random(16)
+end
+local all = assert(sss.create_many(secrets, 4, 3))
+assert(#all == #secrets)
+local quorums = {}
+for i = 1, #all do
+  quorums[i] = {all[i][4], all[i][1], all[i][2]}
+end
+local back = sss.combine_many(quorums)
+for i = 1, #secrets do
+  assert(back[i] == secrets[i])
+end
+
+local blob = table.concat(secrets)
+all = assert(sss.create_many(blob, 3, 2, {len = 16, set = true}))
+assert(#all == #secrets)
+for i = 1, #all do
+  all[i] = all[i]:slice(1, 2)
+end
+back = sss.combine_many(all)
+for i = 1, #secrets do
+  assert(back[i] == secrets[i])
+end
+assert(not pcall(sss.create_many, blob, 3, 2, {len = 15}))
+for _, name in ipairs({'gf256', 'gf65536', 'prime'}) do
+  assert(not pcall(sss.create_many, blob, 3, 2, {backend = name}))
+  assert(not pcall(sss.create_many, blob, 3, 2, {backend = name, len = 0}))
+  assert(not pcall(sss.create_many, blob, 3, 2, {backend = name, len = -16}))
+end
+
+-- streams of chunks give the same shares as create
+if gf256 then
+  local sp = sss.splitter(5, 3, {xs = {9, 8, 7, 6, 5}})
+  local parts = {{}, {}, {}, {}, {}}
+  for _, chunk in ipairs({'', 'ab', sss.random(3000), 'z'}) do
+    local out = sp:update(chunk)
+    assert(#out == 5)
+    for i = 1, 5 do
+      table.insert(parts[i], out[i])
+    end
+  end
+  for i, chunk in ipairs(sp:final()) do
+    table.insert(parts[i], chunk)
+  end
+  for i = 1, 5 do
+    parts[i] = table.concat(parts[i])
+  end
+  assert(parts[1]:byte() == 9 and parts[5]:byte() == 5)
+  assert(not pcall(sp.update, sp, 'x'))
+  msg = assert(sss.combine({parts[2], parts[4], parts[5]}))
+  assert(#msg == 3003 and msg:sub(1, 2) == 'ab' and msg:sub(-1) == 'z')
+
+  local jn = sss.joiner()
+  local out = {}
+  for off = 1, #parts[1], 700 do
+    local chunks = {}
+    for i, p in ipairs({parts[3], parts[1], parts[5]}) do
+      chunks[i] = p:sub(off, off + 699)
+    end
+    table.insert(out, assert(jn:update(chunks)))
+  end
+  assert(jn:final() == '')
+  assert(table.concat(out) == msg)
+  assert(sss.joiner():update({parts[1], parts[1]}) == nil)
+end
+
+-- the same results on several threads
+assert(sss.set_threads(1) == 1)
+local threads = sss.set_threads(4)
+assert(threads >= 1 and threads <= 4)
+for _, len in ipairs({gf256 and 300000 or 32, 16}) do
+  msg = sss.random(len)
+  t = assert(sss.create(msg, 5, 3))
+  assert(sss.combine({t[5], t[3], t[1]}) == msg)
+end
+secrets = {}
+for i = 1, 300 do
+  secrets[i] = sss.random(32)
+end
+all = assert(sss.create_many(secrets, 3, 2))
+quorums = {}
+for i = 1, #all do
+  quorums[i] = {all[i][1], all[i][3]}
+end
+back = sss.combine_many(quorums)
+for i = 1, #secrets do
+  assert(back[i] == secrets[i])
+end
+assert(sss.set_threads(1) == 1)
+
+-- jobs running on a thread of their own
+msg = sss.random(gf256 and 100000 or 32)
+local job = sss.create_async(msg, 4, 2)
+t = assert(job:wait())
+assert(job:wait()[3] == t[3])
+job = sss.combine_async({t[4], t[2]})
+while not job:poll() do end
+assert(job:wait() == msg)
+assert(sss.combine_async({t[1], t[3]}):await() == msg)
+set = assert(sss.create_async(msg, 3, 2, {set = true}):wait())
+assert(#set == 3)
+
+local co = coroutine.wrap(function()
+  return sss.combine_async({t[2], t[3]}):await()
+end)
+local res = co()
+while type(res) ~= 'string' do
+  res = co()
+end
+assert(res == msg)